@@ -0,0 +1,63 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+    double *lat;
+    long n, cap;
+    long nodes;
+} BenchSeries;
+
+static inline double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench_add(BenchSeries *b, double seconds, long nodes) {
+    if (b->n == b->cap) {
+        b->cap = b->cap ? b->cap * 2 : 1024;
+        b->lat = realloc(b->lat, b->cap * sizeof(double));
+    }
+    b->lat[b->n++] = seconds;
+    b->nodes += nodes;
+}
+
+static int bench_cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_begin(FILE *json, const char *program) {
+    if (json) fprintf(json, "{\n  \"program\": \"%s\",\n  \"results\": [", program);
+}
+
+static void bench_end(FILE *json) {
+    if (json) fprintf(json, "\n  ]\n}\n");
+}
+
+// Prints one summary line and appends the series to the JSON results array.
+static void bench_report(FILE *json, int *first, const char *name, BenchSeries *b) {
+    if (!b->n) return;
+    double total = 0;
+    for (long i = 0; i < b->n; i++) total += b->lat[i];
+    qsort(b->lat, b->n, sizeof(double), bench_cmp);
+    double p50 = b->lat[b->n / 2] * 1e6, p99 = b->lat[(long)(b->n * 0.99)] * 1e6, max = b->lat[b->n - 1] * 1e6;
+    double rate = b->n / total, nodes = (double)b->nodes / b->n;
+
+    printf("%-16s %8ld  %12.1f/s  p50 %9.1fus  p99 %9.1fus  max %9.1fus  nodes %10.1f\n",
+           name, b->n, rate, p50, p99, max, nodes);
+    if (json) {
+        fprintf(json, "%s\n    { \"name\": \"%s\", \"count\": %ld, \"per_sec\": %.1f, \"p50_us\": %.2f, "
+                "\"p99_us\": %.2f, \"max_us\": %.2f, \"nodes\": %ld, \"nodes_per_item\": %.2f }",
+                *first ? "" : ",", name, b->n, rate, p50, p99, max, b->nodes, nodes);
+        *first = 0;
+    }
+    free(b->lat);
+    *b = (BenchSeries){0};
+}
+
+#endif
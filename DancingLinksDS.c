@@ -1,229 +1,1593 @@
 #include "DancingLinksDS.h"
+#include "Bench.h"
+#include "PuzzleFile.h"
+#include "Stats.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <limits.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-#define N 9
-#define NUM_COLS 324
-#define NUM_ROWS 729
+#define N DLX_N
+#define CELLS DLX_CELLS
+#define NUM_COLS DLX_COLS
+#define NUM_ROWS DLX_ROWS
 
-static inline int encode(int r, int c, int d) { return r*81 + c*9 + d; }
-static inline void decode(int id, int *r, int *c, int *d) { *d = id%9; *c = (id/9)%9; *r = id/81; }
+#ifdef STATS
+typedef struct {
+    long dlx_nodes, covers, uncovers, choose_cols, bucket_scans, resets, bits_nodes;
+    long grids, generate_ns, carve_steps, carve_step_ns;
+} Stats;
+
+static _Thread_local Stats stats;
+static Stats stats_total;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *stats_path;
+static FILE *stats_lines;
+
+static void stats_merge(void) {
+    pthread_mutex_lock(&stats_lock);
+    stats_accumulate(&stats_total, &stats, NULL, sizeof(Stats));
+    memset(&stats, 0, sizeof(Stats));
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void stats_print(FILE *f, const Stats *s, const char *key, const char *value, int len) {
+    fprintf(f, "{\"%s\": \"%.*s\", \"dlx_nodes\": %ld, \"covers\": %ld, \"uncovers\": %ld, \"choose_cols\": %ld, "
+            "\"bucket_scans\": %ld, \"resets\": %ld, \"bits_nodes\": %ld, \"grids\": %ld, \"generate_ns\": %ld, "
+            "\"carve_steps\": %ld, \"carve_step_ns\": %ld}\n", key, len, value, s->dlx_nodes, s->covers, s->uncovers,
+            s->choose_cols, s->bucket_scans, s->resets, s->bits_nodes, s->grids, s->generate_ns, s->carve_steps,
+            s->carve_step_ns);
+}
+
+static void stats_puzzle(const Stats *before, const char *line) {
+    if (!stats_lines) return;
+    Stats d = {0};
+    stats_accumulate(&d, &stats, before, sizeof(Stats));
+    stats_print(stats_lines, &d, "puzzle", line, CELLS);
+}
+
+static void stats_finish(void) {
+    stats_merge();
+    if (stats_lines) fclose(stats_lines);
+    FILE *f = stats_path ? fopen(stats_path, "w") : NULL;
+    if (stats_path && !f) { perror(stats_path); return; }
+    if (f) { stats_print(f, &stats_total, "program", "generator", 9); fclose(f); }
+}
+#endif
+
+// xoshiro256**, seeded through splitmix64 so that every (seed, stream) pair
+// starts its own sequence.
+static inline uint64_t rotl(uint64_t x, int k) { return x << k | x >> (64 - k); }
+
+static inline uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15);
+    z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9;
+    z = (z ^ z >> 27) * 0x94d049bb133111eb;
+    return z ^ z >> 31;
+}
+
+static void rng_seed(Rng *rng, uint64_t seed, uint64_t stream) {
+    uint64_t x = splitmix64(&seed) ^ stream;
+    for (int i = 0; i < 4; i++) rng->s[i] = splitmix64(&x);
+}
+
+static inline uint64_t rng_next(Rng *rng) {
+    uint64_t *s = rng->s, r = rotl(s[1] * 5, 7) * 9, t = s[1] << 17;
+    s[2] ^= s[0]; s[3] ^= s[1]; s[1] ^= s[2]; s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return r;
+}
+
+// Uniform in [0, n) up to a bias of n/2^32, by multiply-shift instead of a division.
+static inline int rng_below(Rng *rng, int n) { return (int)((rng_next(rng) >> 32) * n >> 32); }
+
+static inline int encode(int r, int c, int d) { return r*CELLS + c*N + d; }
+static inline void decode(int id, int *r, int *c, int *d) { *d = id%N; *c = (id/N)%N; *r = id/CELLS; }
 
 static inline void get_cols(int r, int c, int d, int *out) {
-    int box = (r/3)*3 + c/3;
-    out[0] = r*9 + c;
-    out[1] = 81 + r*9 + d;
-    out[2] = 162 + c*9 + d;
-    out[3] = 243 + box*9 + d;
+    int box = (r/BOX)*BOX + c/BOX;
+    out[0] = r*N + c;
+    out[1] = CELLS + r*N + d;
+    out[2] = 2*CELLS + c*N + d;
+    out[3] = 3*CELLS + box*N + d;
+}
+
+#define ROOT 0
+#define ROW_NODE(id) (1 + NUM_COLS + (id) * 4)
+#define BUCKET(size) (1 + NUM_COLS + (size))
+
+static inline void bucket_remove(DLX *dlx, int c) {
+    dlx->bnext[dlx->bprev[c]] = dlx->bnext[c];
+    dlx->bprev[dlx->bnext[c]] = dlx->bprev[c];
+}
+
+static inline void bucket_insert(DLX *dlx, int c) {
+    int h = BUCKET(dlx->size[c]);
+    dlx->bnext[c] = dlx->bnext[h];
+    dlx->bprev[c] = h;
+    dlx->bprev[dlx->bnext[h]] = c;
+    dlx->bnext[h] = c;
 }
 
 static void link_row(DLX *dlx, int r, int c, int d) {
     int id = encode(r, c, d);
-    int base = id * 4;
+    int base = ROW_NODE(id);
     int cols[4];
     get_cols(r, c, d, cols);
 
     for (int i = 0; i < 4; i++) {
-        Node *node = &dlx->all_nodes[base + i];
-        ColumnHeader *col = dlx->columns[cols[i]];
-        node->row_id = id;
-        node->column = col;
-        node->up = col->node.up;
-        node->down = &col->node;
-        col->node.up->down = node;
-        col->node.up = node;
-        col->size++;
+        int n = base + i, col = cols[i] + 1;
+        dlx->row[n] = id;
+        dlx->col[n] = col;
+        dlx->up[n] = dlx->up[col];
+        dlx->down[n] = col;
+        dlx->down[dlx->up[col]] = n;
+        dlx->up[col] = n;
+        dlx->size[col]++;
+        dlx->left[n] = base + (i+3)%4;
+        dlx->right[n] = base + (i+1)%4;
     }
+}
 
-    for (int i = 0; i < 4; i++) {
-        Node *node = &dlx->all_nodes[base + i];
-        node->left = &dlx->all_nodes[base + (i+3)%4];
-        node->right = &dlx->all_nodes[base + (i+1)%4];
+// The empty matrix is the same for every search, so it is linked once into a
+// template and reset copies its link arrays (everything before `stack`).
+static DLX dlx_template;
+static pthread_once_t dlx_template_once = PTHREAD_ONCE_INIT;
+
+static void dlx_build_template(void) {
+    DLX *dlx = &dlx_template;
+    dlx->left[ROOT] = dlx->right[ROOT] = ROOT;
+    for (int col = 1; col <= NUM_COLS; col++) {
+        dlx->up[col] = dlx->down[col] = col;
+        dlx->col[col] = col;
+        dlx->size[col] = 0;
+        dlx->left[col] = dlx->left[ROOT];
+        dlx->right[col] = ROOT;
+        dlx->right[dlx->left[ROOT]] = col;
+        dlx->left[ROOT] = col;
     }
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++)
+            for (int d = 0; d < N; d++)
+                link_row(dlx, r, c, d);
+    for (int s = 0; s < DLX_BUCKETS; s++) dlx->bnext[BUCKET(s)] = dlx->bprev[BUCKET(s)] = BUCKET(s);
+    for (int col = 1; col <= NUM_COLS; col++) bucket_insert(dlx, col);
 }
 
 DLX *dlx_create(void) {
     DLX *dlx = malloc(sizeof(DLX));
-    dlx->solution = malloc(81 * sizeof(int));
-    dlx->all_nodes = malloc(NUM_ROWS * 4 * sizeof(Node));
-    dlx->root = malloc(sizeof(ColumnHeader));
-    dlx->columns = malloc(NUM_COLS * sizeof(ColumnHeader *));
-    dlx->root->node.column = dlx->root;
-    for (int i = 0; i < NUM_COLS; i++) {
-        dlx->columns[i] = malloc(sizeof(ColumnHeader));
-        dlx->columns[i]->node.column = dlx->columns[i];
-    }
+    dlx->nodes = 0;
     dlx_reset(dlx);
     return dlx;
 }
 
 void dlx_reset(DLX *dlx) {
-    dlx->root->node.left = dlx->root->node.right = &dlx->root->node;
-    for (int i = 0; i < NUM_COLS; i++) {
-        ColumnHeader *col = dlx->columns[i];
-        col->node.up = col->node.down = &col->node;
-        col->size = 0;
-        col->node.left = dlx->root->node.left;
-        col->node.right = &dlx->root->node;
-        dlx->root->node.left->right = &col->node;
-        dlx->root->node.left = &col->node;
-    }
-    for (int r = 0; r < N; r++)
-        for (int c = 0; c < N; c++)
-            for (int d = 0; d < N; d++)
-                link_row(dlx, r, c, d);
+    pthread_once(&dlx_template_once, dlx_build_template);
+    memcpy(dlx, &dlx_template, offsetof(DLX, stack));
+    STAT_INC(resets);
+    dlx->depth = 0;
     dlx->solutions_found = 0;
 }
 
 void dlx_destroy(DLX *dlx) {
-    for (int i = 0; i < NUM_COLS; i++) free(dlx->columns[i]);
-    free(dlx->columns);
-    free(dlx->all_nodes);
-    free(dlx->root);
-    free(dlx->solution);
     free(dlx);
 }
 
-static void cover(ColumnHeader *col) {
-    col->node.right->left = col->node.left;
-    col->node.left->right = col->node.right;
-    for (Node *r = col->node.down; r != &col->node; r = r->down)
-        for (Node *n = r->right; n != r; n = n->right) {
-            n->down->up = n->up;
-            n->up->down = n->down;
-            n->column->size--;
+static void cover(DLX *dlx, int col) {
+    uint16_t *L = dlx->left, *R = dlx->right, *U = dlx->up, *D = dlx->down;
+    STAT_INC(covers);
+    R[L[col]] = R[col];
+    L[R[col]] = L[col];
+    bucket_remove(dlx, col);
+    for (int r = D[col]; r != col; r = D[r])
+        for (int n = R[r]; n != r; n = R[n]) {
+            int c = dlx->col[n];
+            U[D[n]] = U[n];
+            D[U[n]] = D[n];
+            bucket_remove(dlx, c);
+            dlx->size[c]--;
+            bucket_insert(dlx, c);
         }
 }
 
-static void uncover(ColumnHeader *col) {
-    for (Node *r = col->node.up; r != &col->node; r = r->up)
-        for (Node *n = r->left; n != r; n = n->left) {
-            n->column->size++;
-            n->down->up = n;
-            n->up->down = n;
+static void uncover(DLX *dlx, int col) {
+    uint16_t *L = dlx->left, *R = dlx->right, *U = dlx->up, *D = dlx->down;
+    STAT_INC(uncovers);
+    for (int r = U[col]; r != col; r = U[r])
+        for (int n = L[r]; n != r; n = L[n]) {
+            int c = dlx->col[n];
+            bucket_remove(dlx, c);
+            dlx->size[c]++;
+            bucket_insert(dlx, c);
+            U[D[n]] = n;
+            D[U[n]] = n;
         }
-    col->node.right->left = &col->node;
-    col->node.left->right = &col->node;
+    bucket_insert(dlx, col);
+    R[L[col]] = col;
+    L[R[col]] = col;
 }
 
-static ColumnHeader *choose_col(DLX *dlx) {
-    ColumnHeader *best = NULL;
-    int min = INT_MAX;
-    for (Node *n = dlx->root->node.right; n != &dlx->root->node; n = n->right) {
-        ColumnHeader *c = (ColumnHeader *)n;
-        if (c->size < min) { min = c->size; best = c; }
+static int choose_col(DLX *dlx) {
+    STAT_INC(choose_cols);
+    for (int s = 0; s < DLX_BUCKETS; s++) {
+        STAT_INC(bucket_scans);
+        if (dlx->bnext[BUCKET(s)] != BUCKET(s)) return dlx->bnext[BUCKET(s)];
     }
-    return best;
+    return ROOT;
 }
 
 static void apply_clue(DLX *dlx, int r, int c, int d) {
     int cols[4];
     get_cols(r, c, d, cols);
-    for (int i = 0; i < 4; i++) cover(dlx->columns[cols[i]]);
+    for (int i = 0; i < 4; i++) cover(dlx, cols[i] + 1);
+}
+
+static void remove_clue(DLX *dlx, int r, int c, int d) {
+    int cols[4];
+    get_cols(r, c, d, cols);
+    for (int i = 3; i >= 0; i--) uncover(dlx, cols[i] + 1);
+}
+
+typedef enum { WALK_DONE, WALK_SOLUTION, WALK_PAUSED } WalkStatus;
+
+static void dlx_begin(DLX *dlx) {
+    dlx->depth = 0;
+    dlx->descend = true;
+    dlx->solutions_found = 0;
+}
+
+static void retract(DLX *dlx, DLXLevel *lv) {
+    int row = lv->rows[lv->next - 1];
+    for (int r = dlx->left[row]; r != row; r = dlx->left[r]) uncover(dlx, dlx->col[r]);
+}
+
+// Runs the walk until it reaches a solution, is exhausted, or has visited
+// `limit` nodes in total. Rows are shuffled with `rng` unless it is NULL.
+// After WALK_SOLUTION the solution stays covered; calling again moves on
+// to the next one.
+static WalkStatus dlx_walk(DLX *dlx, Rng *rng, long limit) {
+    DLXLevel *lv;
+    for (;;) {
+        if (dlx->descend) {
+            if (dlx->nodes >= limit) return WALK_PAUSED;
+            dlx->nodes++;
+            STAT_INC(dlx_nodes);
+            dlx->descend = false;
+            if (dlx->right[ROOT] == ROOT) { dlx->solutions_found++; return WALK_SOLUTION; }
+            int col = choose_col(dlx);
+            if (dlx->size[col] == 0) continue;
+
+            lv = &dlx->stack[dlx->depth++];
+            lv->col = col;
+            lv->n = lv->next = 0;
+            for (int r = dlx->down[col]; r != col; r = dlx->down[r]) lv->rows[lv->n++] = r;
+            if (rng)
+                for (int i = lv->n-1; i > 0; i--) { int j = rng_below(rng, i+1); uint16_t t = lv->rows[i]; lv->rows[i] = lv->rows[j]; lv->rows[j] = t; }
+            cover(dlx, col);
+        } else {
+            if (dlx->depth == 0) return WALK_DONE;
+            lv = &dlx->stack[dlx->depth - 1];
+            retract(dlx, lv);
+        }
+
+        while (lv->next == lv->n) {
+            uncover(dlx, lv->col);
+            if (--dlx->depth == 0) return WALK_DONE;
+            lv = &dlx->stack[dlx->depth - 1];
+            retract(dlx, lv);
+        }
+        int row = lv->rows[lv->next++];
+        dlx->solution[dlx->depth - 1] = dlx->row[row];
+        for (int r = dlx->right[row]; r != row; r = dlx->right[r]) cover(dlx, dlx->col[r]);
+        dlx->descend = true;
+    }
+}
+
+// Tracks one call against an optional budget; the clock is read only when a
+// budget is given, and deadlines are checked every BUDGET_SLICE nodes.
+#define BUDGET_SLICE 1024
+
+typedef struct {
+    Budget *b;
+    long start, stop;
+    double t0, deadline;
+    bool exceeded;
+} Meter;
+
+static Meter meter_begin(Budget *b, long nodes) {
+    Meter m = { .b = b, .start = nodes, .stop = LONG_MAX };
+    if (!b) return m;
+    if (b->max_nodes) m.stop = nodes + b->max_nodes;
+    m.t0 = bench_now();
+    if (b->max_seconds) m.deadline = m.t0 + b->max_seconds;
+    return m;
+}
+
+static inline bool meter_late(const Meter *m) {
+    return m->deadline && bench_now() >= m->deadline;
+}
+
+// For calls that check between steps rather than nodes: marks the meter
+// exceeded once either limit is reached.
+static bool meter_spent(Meter *m, long nodes) {
+    if (nodes >= m->stop || meter_late(m)) m->exceeded = true;
+    return m->exceeded;
+}
+
+// Records how far the call got and returns its result.
+static int meter_end(const Meter *m, long nodes, int solutions) {
+    if (m->b) {
+        m->b->nodes = nodes - m->start;
+        m->b->solutions = solutions;
+        m->b->seconds = bench_now() - m->t0;
+        m->b->exceeded = m->exceeded;
+    }
+    return m->exceeded ? BUDGET_EXCEEDED : solutions;
+}
+
+// dlx_walk in slices short enough to check the deadline between them.
+static WalkStatus walk_metered(DLX *dlx, Rng *rng, Meter *m) {
+    for (;;) {
+        long limit = m->deadline && m->stop - dlx->nodes > BUDGET_SLICE ? dlx->nodes + BUDGET_SLICE : m->stop;
+        WalkStatus s = dlx_walk(dlx, rng, limit);
+        if (s != WALK_PAUSED) return s;
+        if (dlx->nodes >= m->stop || meter_late(m)) { m->exceeded = true; return s; }
+    }
+}
+
+// Undoes every level still open so the matrix is back where dlx_begin found it.
+static void dlx_unwind(DLX *dlx) {
+    while (dlx->depth > 0) {
+        DLXLevel *lv = &dlx->stack[--dlx->depth];
+        if (lv->next) retract(dlx, lv);
+        uncover(dlx, lv->col);
+    }
+}
+
+static int search(DLX *dlx, Rng *rng, Budget *b) {
+    Meter m = meter_begin(b, dlx->nodes);
+    dlx_begin(dlx);
+    if (walk_metered(dlx, rng, &m) == WALK_PAUSED) dlx_unwind(dlx);
+    return meter_end(&m, dlx->nodes, dlx->solutions_found);
+}
+
+static int count(DLX *dlx, int max, Budget *b) {
+    Meter m = meter_begin(b, dlx->nodes);
+    dlx_begin(dlx);
+    while (dlx->solutions_found < max && walk_metered(dlx, NULL, &m) == WALK_SOLUTION);
+    dlx_unwind(dlx);
+    return meter_end(&m, dlx->nodes, dlx->solutions_found);
+}
+
+// Parallel count: the top of the tree is split into prefixes of row nodes,
+// and each worker replays a prefix on its own copy of the matrix and walks the
+// subtree below it. Workers own contiguous ranges of prefixes and steal the
+// upper half of the largest remaining range once their own is empty. Walks
+// pause every COUNT_SLICE nodes to check the shared count against max and
+// the shared node total and deadline against the budget.
+#define SPLIT_TASKS 16
+#define COUNT_SLICE 4096
+
+typedef struct { uint16_t rows[DLX_DEPTH]; int n; } Prefix;
+
+typedef struct {
+    int lo, hi;
+    pthread_mutex_t lock;
+} TaskRange;
+
+typedef struct {
+    const DLX *base;
+    const Meter *meter;
+    Prefix *tasks;
+    TaskRange *ranges;
+    int threads, max;
+    atomic_int found;
+    atomic_long nodes;
+    atomic_bool exceeded;
+} CountPool;
+
+// Count workers are started on first use and then kept, parked on a condvar
+// between calls, so a run of --check lines pays no thread create and join
+// per puzzle. Each keeps its matrix copy too. Calls take turns on the crew.
+typedef struct {
+    pthread_mutex_t turn, lock;
+    pthread_cond_t work, done;
+    CountPool *job;
+    unsigned long round;
+    int started, running;
+} CountCrew;
+
+static CountCrew crew = { .turn = PTHREAD_MUTEX_INITIALIZER, .lock = PTHREAD_MUTEX_INITIALIZER,
+                          .work = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER };
+
+static void replay(DLX *dlx, const Prefix *p) {
+    for (int i = 0; i < p->n; i++) {
+        int row = p->rows[i];
+        cover(dlx, dlx->col[row]);
+        for (int r = dlx->right[row]; r != row; r = dlx->right[r]) cover(dlx, dlx->col[r]);
+    }
 }
 
-static bool search(DLX *dlx, int depth) {
-    if (dlx->root->node.right == &dlx->root->node) { dlx->solutions_found++; return true; }
-    ColumnHeader *col = choose_col(dlx);
-    if (col->size == 0) return false;
+static void unreplay(DLX *dlx, const Prefix *p) {
+    for (int i = p->n - 1; i >= 0; i--) {
+        int row = p->rows[i];
+        for (int r = dlx->left[row]; r != row; r = dlx->left[r]) uncover(dlx, dlx->col[r]);
+        uncover(dlx, dlx->col[row]);
+    }
+}
 
-    int n = col->size;
-    Node **rows = malloc(n * sizeof(Node *));
-    int i = 0;
-    for (Node *r = col->node.down; r != &col->node; r = r->down) rows[i++] = r;
-    for (int i = n-1; i > 0; i--) { int j = rand()%(i+1); Node *t = rows[i]; rows[i] = rows[j]; rows[j] = t; }
+typedef struct {
+    Prefix *tasks;
+    int n, cap;
+} Split;
 
-    cover(col);
-    for (int i = 0; i < n; i++) {
-        Node *row = rows[i];
-        dlx->solution[depth] = row->row_id;
-        for (Node *r = row->right; r != row; r = r->right) cover(r->column);
-        if (search(dlx, depth + 1)) { free(rows); uncover(col); return true; }
-        for (Node *r = row->left; r != row; r = r->left) uncover(r->column);
+// Splits the tree below the current cover into about `share` prefixes in one
+// pass: each branch gets an equal part of its parent's share and becomes a
+// prefix once that reaches 1, so forced moves never divide it. Dead ends are
+// dropped and complete covers kept as they are.
+static void split_dfs(DLX *dlx, Prefix *p, int share, Split *sp) {
+    if (share <= 1 || dlx->right[ROOT] == ROOT) {
+        if (sp->n == sp->cap) sp->tasks = realloc(sp->tasks, (sp->cap = 2*sp->cap + 16) * sizeof(Prefix));
+        sp->tasks[sp->n++] = *p;
+        return;
     }
-    uncover(col);
-    free(rows);
-    return false;
+    int col = choose_col(dlx), k = dlx->size[col];
+    dlx->nodes++;
+    STAT_INC(dlx_nodes);
+    cover(dlx, col);
+    for (int row = dlx->down[col]; row != col; row = dlx->down[row]) {
+        for (int r = dlx->right[row]; r != row; r = dlx->right[r]) cover(dlx, dlx->col[r]);
+        p->rows[p->n++] = row;
+        split_dfs(dlx, p, (share + k - 1) / k, sp);
+        p->n--;
+        for (int r = dlx->left[row]; r != row; r = dlx->left[r]) uncover(dlx, dlx->col[r]);
+    }
+    uncover(dlx, col);
+}
+
+static int split_tree(DLX *dlx, int want, Prefix **out) {
+    Split sp = {0};
+    Prefix p = { .n = 0 };
+    split_dfs(dlx, &p, want, &sp);
+    *out = sp.tasks;
+    return sp.n;
 }
 
-static int count(DLX *dlx, int depth, int max) {
-    if (dlx->root->node.right == &dlx->root->node) return ++dlx->solutions_found;
-    ColumnHeader *col = choose_col(dlx);
-    if (col->size == 0) return dlx->solutions_found;
-    cover(col);
-    for (Node *row = col->node.down; row != &col->node; row = row->down) {
-        dlx->solution[depth] = row->row_id;
-        for (Node *r = row->right; r != row; r = r->right) cover(r->column);
-        count(dlx, depth + 1, max);
-        if (dlx->solutions_found >= max) {
-            for (Node *r = row->left; r != row; r = r->left) uncover(r->column);
-            uncover(col);
-            return dlx->solutions_found;
+static int take_task(CountPool *pool, int id) {
+    TaskRange *own = &pool->ranges[id];
+    pthread_mutex_lock(&own->lock);
+    int t = own->lo < own->hi ? own->lo++ : -1;
+    pthread_mutex_unlock(&own->lock);
+    if (t >= 0) return t;
+
+    for (;;) {
+        int victim = -1, most = 0;
+        for (int k = 0; k < pool->threads; k++) {
+            pthread_mutex_lock(&pool->ranges[k].lock);
+            int left = pool->ranges[k].hi - pool->ranges[k].lo;
+            pthread_mutex_unlock(&pool->ranges[k].lock);
+            if (left > most) { most = left; victim = k; }
         }
-        for (Node *r = row->left; r != row; r = r->left) uncover(r->column);
+        if (victim < 0) return -1;
+
+        TaskRange *v = &pool->ranges[victim];
+        pthread_mutex_lock(&v->lock);
+        int lo = v->lo + (v->hi - v->lo) / 2, hi = v->hi;
+        if (lo < hi) v->hi = lo;
+        pthread_mutex_unlock(&v->lock);
+        if (lo >= hi) continue;
+
+        pthread_mutex_lock(&own->lock);
+        own->lo = lo + 1;
+        own->hi = hi;
+        pthread_mutex_unlock(&own->lock);
+        return lo;
     }
-    uncover(col);
-    return dlx->solutions_found;
 }
 
-static void extract(DLX *dlx, int grid[9][9]) {
-    for (int i = 0; i < 81; i++) { int r,c,d; decode(dlx->solution[i], &r, &c, &d); grid[r][c] = d+1; }
+static bool count_stopped(CountPool *pool) {
+    return atomic_load(&pool->found) >= pool->max || atomic_load(&pool->exceeded);
+}
+
+static void count_job(CountPool *pool, int id, DLX *dlx) {
+    memcpy(dlx, pool->base, offsetof(DLX, stack));
+    dlx->nodes = 0;
+
+    int t;
+    while (!count_stopped(pool) && (t = take_task(pool, id)) >= 0) {
+        replay(dlx, &pool->tasks[t]);
+        dlx_begin(dlx);
+        for (;;) {
+            long seen = dlx->nodes;
+            WalkStatus s = dlx_walk(dlx, NULL, dlx->nodes + COUNT_SLICE);
+            long total = atomic_fetch_add(&pool->nodes, dlx->nodes - seen) + dlx->nodes - seen;
+            if (s == WALK_SOLUTION) atomic_fetch_add(&pool->found, 1);
+            if (total >= pool->meter->stop || meter_late(pool->meter)) atomic_store(&pool->exceeded, true);
+            if (s == WALK_DONE || count_stopped(pool)) break;
+        }
+        dlx_unwind(dlx);
+        unreplay(dlx, &pool->tasks[t]);
+    }
+    STAT_MERGE();
 }
 
-bool sudoku_generate(int grid[9][9]) {
+// Worker id runs every job that wants at least id+1 threads.
+static void *count_worker(void *arg) {
+    int id = (int)(intptr_t)arg;
+    DLX *dlx = malloc(sizeof(DLX));
+    unsigned long seen = 0;
+    pthread_mutex_lock(&crew.lock);
+    for (;;) {
+        while (crew.round == seen) pthread_cond_wait(&crew.work, &crew.lock);
+        seen = crew.round;
+        CountPool *pool = crew.job;
+        if (id >= pool->threads) continue;
+        pthread_mutex_unlock(&crew.lock);
+        count_job(pool, id, dlx);
+        pthread_mutex_lock(&crew.lock);
+        if (--crew.running == 0) pthread_cond_signal(&crew.done);
+    }
+    return NULL;
+}
+
+// Runs pool on the crew, starting workers up to pool->threads, and returns
+// once every one of them has finished with it.
+static void crew_run(CountPool *pool) {
+    pthread_mutex_lock(&crew.turn);
+    pthread_mutex_lock(&crew.lock);
+    for (; crew.started < pool->threads; crew.started++) {
+        pthread_t tid;
+        pthread_create(&tid, NULL, count_worker, (void *)(intptr_t)crew.started);
+        pthread_detach(tid);
+    }
+    crew.job = pool;
+    crew.running = pool->threads;
+    crew.round++;
+    pthread_cond_broadcast(&crew.work);
+    while (crew.running) pthread_cond_wait(&crew.done, &crew.lock);
+    crew.job = NULL;
+    pthread_mutex_unlock(&crew.lock);
+    pthread_mutex_unlock(&crew.turn);
+}
+
+static int count_parallel(DLX *dlx, int max, int threads, Budget *b) {
+    if (threads < 2) return count(dlx, max, b);
+
+    Meter m = meter_begin(b, dlx->nodes);
+    CountPool pool = { .base = dlx, .meter = &m, .threads = threads, .max = max };
+    int n = split_tree(dlx, SPLIT_TASKS * threads, &pool.tasks);
+    atomic_init(&pool.found, 0);
+    atomic_init(&pool.nodes, dlx->nodes);
+    atomic_init(&pool.exceeded, false);
+    pool.ranges = malloc(threads * sizeof(TaskRange));
+    for (int k = 0; k < threads; k++) {
+        pool.ranges[k].lo = (long)n * k / threads;
+        pool.ranges[k].hi = (long)n * (k+1) / threads;
+        pthread_mutex_init(&pool.ranges[k].lock, NULL);
+    }
+    crew_run(&pool);
+    for (int k = 0; k < threads; k++) pthread_mutex_destroy(&pool.ranges[k].lock);
+
+    int found = atomic_load(&pool.found);
+    dlx->nodes = atomic_load(&pool.nodes);
+    dlx->solutions_found = found < max ? found : max;
+    m.exceeded = found < max && atomic_load(&pool.exceeded);
+    free(pool.ranges);
+    free(pool.tasks);
+    return meter_end(&m, dlx->nodes, dlx->solutions_found);
+}
+
+// Covers the clues of puzzle on a fresh matrix; false if two clues clash.
+static bool dlx_load(DLX *dlx, int puzzle[N][N]) {
+    dlx_reset(dlx);
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++) {
+            if (!puzzle[r][c]) continue;
+            int cols[4];
+            get_cols(r, c, puzzle[r][c]-1, cols);
+            for (int i = 0; i < 4; i++)
+                if (dlx->right[dlx->left[cols[i] + 1]] != cols[i] + 1) return false;
+            apply_clue(dlx, r, c, puzzle[r][c]-1);
+        }
+    return true;
+}
+
+int sudoku_count_solutions_parallel(int puzzle[N][N], int max, int threads, Budget *budget) {
     DLX *dlx = dlx_create();
-    bool ok = search(dlx, 0);
-    if (ok) extract(dlx, grid);
+    Meter m = meter_begin(budget, 0);
+    int found = dlx_load(dlx, puzzle) ? count_parallel(dlx, max, threads, budget) : meter_end(&m, 0, 0);
     dlx_destroy(dlx);
-    return ok;
+    return found;
 }
 
-int sudoku_create_puzzle(int full[9][9], int puzzle[9][9]) {
-    for (int i = 0; i < 81; i++) puzzle[i/9][i%9] = full[i/9][i%9];
+// Digit masks need N bits plus the PLACED flag above them.
+#if N < 16
+typedef uint16_t mask_t;
+#else
+typedef uint32_t mask_t;
+#endif
+#if CELLS <= 256
+typedef uint8_t cell_t;
+#else
+typedef uint16_t cell_t;
+#endif
 
-    int pos[81]; for (int i = 0; i < 81; i++) pos[i] = i;
-    for (int i = 80; i > 0; i--) { int j = rand()%(i+1); int t = pos[i]; pos[i] = pos[j]; pos[j] = t; }
+#define PLACED ((mask_t)1 << N)
+#define ALL_DIGITS (PLACED - 1)
+#define PEERS (3*N - 2*BOX - 1)
 
-    DLX *dlx = dlx_create();
-    int clues = 81;
+typedef struct {
+    mask_t cands[CELLS];
+    mask_t row_mask[N][N];
+    mask_t col_mask[N][N];
+    mask_t box_mask[N][N];
+    uint8_t grid[CELLS];
+    int unsolved;
+} Bits;
 
-    for (int i = 0; i < 81; i++) {
-        int r = pos[i]/9, c = pos[i]%9;
-        if (!puzzle[r][c]) continue;
-        int saved = puzzle[r][c];
-        puzzle[r][c] = 0;
+static uint8_t cell_box[CELLS];
+static uint8_t cell_boxpos[CELLS];
+static cell_t peers[CELLS][PEERS];
+static cell_t box_cell[N][N];
+static pthread_once_t bits_once = PTHREAD_ONCE_INIT;
 
-        dlx_reset(dlx);
-        for (int rr = 0; rr < 9; rr++)
-            for (int cc = 0; cc < 9; cc++)
-                if (puzzle[rr][cc]) apply_clue(dlx, rr, cc, puzzle[rr][cc]-1);
+static void bits_init_tables(void) {
+    for (int i = 0; i < CELLS; i++) {
+        int r = i/N, c = i%N, p = 0;
+        cell_box[i] = (r/BOX)*BOX + c/BOX;
+        cell_boxpos[i] = (r%BOX)*BOX + c%BOX;
+        for (int j = 0; j < CELLS; j++) {
+            if (j == i) continue;
+            int rr = j/N, cc = j%N;
+            if (rr == r || cc == c || (rr/BOX)*BOX + cc/BOX == cell_box[i]) peers[i][p++] = j;
+        }
+        box_cell[cell_box[i]][cell_boxpos[i]] = i;
+    }
+}
+
+static inline bool bits_clear_unit(mask_t *m, int bit) {
+    *m &= ~((mask_t)1 << bit);
+    return *m != 0;
+}
+
+// Assigns d to cell i and propagates naked singles. Returns false on contradiction.
+static bool bits_place(Bits *b, int i, int d) {
+    int stack[CELLS], n = 0;
+    stack[n++] = i*N + d;
+    while (n) {
+        int id = stack[--n];
+        i = id/N; d = id%N;
+        if (!b->cands[i]) { if (b->grid[i] != d+1) return false; continue; }
+        if (!(b->cands[i] & ((mask_t)1 << d))) return false;
+
+        int r = i/N, c = i%N, bx = cell_box[i], bp = cell_boxpos[i];
+        for (mask_t m = b->cands[i] & ~((mask_t)1 << d); m; m &= m-1) {
+            int dd = __builtin_ctz(m);
+            if (!bits_clear_unit(&b->row_mask[dd][r], c) || !bits_clear_unit(&b->col_mask[dd][c], r) ||
+                !bits_clear_unit(&b->box_mask[dd][bx], bp)) return false;
+        }
+        b->row_mask[d][r] = b->col_mask[d][c] = b->box_mask[d][bx] = PLACED;
+        b->cands[i] = 0;
+        b->grid[i] = d+1;
+        b->unsolved--;
+
+        for (int p = 0; p < PEERS; p++) {
+            int j = peers[i][p];
+            mask_t old = b->cands[j];
+            if (!(old & ((mask_t)1 << d))) continue;
+            mask_t rem = old & ~((mask_t)1 << d);
+            if (!rem) return false;
+            b->cands[j] = rem;
+            if (!bits_clear_unit(&b->row_mask[d][j/N], j%N) || !bits_clear_unit(&b->col_mask[d][j%N], j/N) ||
+                !bits_clear_unit(&b->box_mask[d][cell_box[j]], cell_boxpos[j])) return false;
+            if (!(rem & (rem-1))) stack[n++] = j*N + __builtin_ctz(rem);
+        }
+    }
+    return true;
+}
+
+static bool bits_hidden_singles(Bits *b) {
+    bool progress = true;
+    while (progress && b->unsolved > 0) {
+        progress = false;
+        for (int d = 0; d < N; d++)
+            for (int u = 0; u < N; u++) {
+                mask_t m = b->row_mask[d][u];
+                if (!(m & PLACED) && !(m & (m-1))) {
+                    if (!bits_place(b, u*N + __builtin_ctz(m), d)) return false;
+                    progress = true;
+                }
+                m = b->col_mask[d][u];
+                if (!(m & PLACED) && !(m & (m-1))) {
+                    if (!bits_place(b, __builtin_ctz(m)*N + u, d)) return false;
+                    progress = true;
+                }
+                m = b->box_mask[d][u];
+                if (!(m & PLACED) && !(m & (m-1))) {
+                    if (!bits_place(b, box_cell[u][__builtin_ctz(m)], d)) return false;
+                    progress = true;
+                }
+            }
+    }
+    return true;
+}
+
+static int bits_count(Bits *b, int found, int max, long *nodes, Meter *meter) {
+    if (++*nodes > meter->stop || ((*nodes & (BUDGET_SLICE-1)) == 0 && meter_late(meter))) {
+        meter->exceeded = true;
+        return found;
+    }
+    STAT_INC(bits_nodes);
+    if (!bits_hidden_singles(b)) return found;
+    if (b->unsolved == 0) return found + 1;
+
+    int best = -1, min = N + 1;
+    for (int i = 0; i < CELLS && min > 2; i++) {
+        if (!b->cands[i]) continue;
+        int pc = __builtin_popcount(b->cands[i]);
+        if (pc < min) { min = pc; best = i; }
+    }
+    for (mask_t m = b->cands[best]; m; m &= m-1) {
+        Bits next = *b;
+        if (bits_place(&next, best, __builtin_ctz(m))) found = bits_count(&next, found, max, nodes, meter);
+        if (found >= max || meter->exceeded) break;
+    }
+    return found;
+}
+
+// Loads clues directly from unit masks instead of placing them one by one;
+// singles left behind are picked up by bits_count.
+static bool bits_load(Bits *b, int puzzle[N][N]) {
+    pthread_once(&bits_once, bits_init_tables);
+    mask_t rows[N] = {0}, cols[N] = {0}, boxes[N] = {0};
+    for (int i = 0; i < CELLS; i++) {
+        if (!puzzle[i/N][i%N]) continue;
+        mask_t bit = (mask_t)1 << (puzzle[i/N][i%N]-1);
+        if ((rows[i/N] | cols[i%N] | boxes[cell_box[i]]) & bit) return false;
+        rows[i/N] |= bit; cols[i%N] |= bit; boxes[cell_box[i]] |= bit;
+    }
+    for (int d = 0; d < N; d++)
+        for (int u = 0; u < N; u++) {
+            b->row_mask[d][u] = rows[u] >> d & 1 ? PLACED : 0;
+            b->col_mask[d][u] = cols[u] >> d & 1 ? PLACED : 0;
+            b->box_mask[d][u] = boxes[u] >> d & 1 ? PLACED : 0;
+        }
+    b->unsolved = 0;
+    for (int i = 0; i < CELLS; i++) {
+        int r = i/N, c = i%N;
+        b->grid[i] = puzzle[r][c];
+        if (puzzle[r][c]) { b->cands[i] = 0; continue; }
+        mask_t m = ALL_DIGITS & ~(rows[r] | cols[c] | boxes[cell_box[i]]);
+        if (!m) return false;
+        b->cands[i] = m;
+        b->unsolved++;
+        for (; m; m &= m-1) {
+            int d = __builtin_ctz(m);
+            b->row_mask[d][r] |= (mask_t)1 << c;
+            b->col_mask[d][c] |= (mask_t)1 << r;
+            b->box_mask[d][cell_box[i]] |= (mask_t)1 << cell_boxpos[i];
+        }
+    }
+    for (int d = 0; d < N; d++)
+        for (int u = 0; u < N; u++)
+            if (!b->row_mask[d][u] || !b->col_mask[d][u] || !b->box_mask[d][u]) return false;
+    return true;
+}
+
+int sudoku_count_solutions(int puzzle[N][N], int max) {
+    Bits b;
+    long nodes = 0;
+    Meter m = meter_begin(NULL, 0);
+    return bits_load(&b, puzzle) ? bits_count(&b, 0, max, &nodes, &m) : 0;
+}
 
-        dlx->solutions_found = 0;
-        if (count(dlx, 0, 2) >= 2) puzzle[r][c] = saved;
+// The puzzle was unique with digit d at cell i, so it stays unique without
+// that clue iff no solution puts another digit there. Returns 1 if one does,
+// 0 if not, or BUDGET_EXCEEDED.
+static int bits_has_alternative(int puzzle[N][N], int i, int d, long *nodes, Budget *budget) {
+    Bits b;
+    if (!bits_load(&b, puzzle)) return 0;
+    mask_t rem = b.cands[i] & ~((mask_t)1 << d);
+    if (!rem) return 0;
+    Meter m = meter_begin(budget, *nodes);
+    int found = 0;
+    if (!(rem & (rem-1))) {
+        if (bits_place(&b, i, __builtin_ctz(rem))) found = bits_count(&b, 0, 1, nodes, &m);
+    } else {
+        b.cands[i] = rem;
+        if (bits_clear_unit(&b.row_mask[d][i/N], i%N) && bits_clear_unit(&b.col_mask[d][i%N], i/N) &&
+            bits_clear_unit(&b.box_mask[d][cell_box[i]], cell_boxpos[i])) found = bits_count(&b, 0, 1, nodes, &m);
+    }
+    return meter_end(&m, *nodes, found);
+}
+
+static void extract(DLX *dlx, int grid[N][N]) {
+    for (int i = 0; i < CELLS; i++) { int r,c,d; decode(dlx->solution[i], &r, &c, &d); grid[r][c] = d+1; }
+}
+
+Generator *gen_create(uint64_t seed) {
+    Generator *gen = malloc(sizeof(Generator));
+    gen->dlx = dlx_create();
+    gen->seed = seed;
+    gen->engine = ENGINE_BITS;
+    gen->nodes = 0;
+    gen->transforms = gen->pending = 0;
+    gen->base_group = gen->want_group = 0;
+    gen->budget = (Budget){0};
+    gen->dropped = 0;
+    gen_seek(gen, 0);
+    return gen;
+}
+
+// Puzzle `index` starts on stream `index`. With transforms its grids come from
+// the base grid of group index/(transforms+1), searched on stream ~group and
+// kept while the following indices fall in the same group; base_group and
+// want_group hold group+1 so that zero means none.
+void gen_seek(Generator *gen, uint64_t index) {
+    gen->index = index;
+    gen->pending = 0;
+    gen->want_group = 0;
+    if (gen->transforms > 0) {
+        uint64_t group = index / (gen->transforms + 1);
+        if (gen->base_group == group + 1) {
+            gen->pending = gen->transforms;
+        } else {
+            gen->want_group = group + 1;
+            rng_seed(&gen->rng, gen->seed, ~group);
+            return;
+        }
+    }
+    rng_seed(&gen->rng, gen->seed, index);
+}
+
+void gen_destroy(Generator *gen) {
+    dlx_destroy(gen->dlx);
+    free(gen);
+}
+
+static void shuffle(int *a, int n, Rng *rng) {
+    for (int i = n-1; i > 0; i--) { int j = rng_below(rng, i+1); int t = a[i]; a[i] = a[j]; a[j] = t; }
+}
+
+static void transform_grid(Generator *gen, int src[N][N], int dst[N][N]) {
+    int digit[N+1] = {0}, perm[N], map[2][N];
+    for (int i = 0; i < N; i++) perm[i] = i + 1;
+    shuffle(perm, N, &gen->rng);
+    for (int i = 0; i < N; i++) digit[i+1] = perm[i];
+    for (int axis = 0; axis < 2; axis++) {
+        int band[BOX];
+        for (int b = 0; b < BOX; b++) band[b] = b;
+        shuffle(band, BOX, &gen->rng);
+        for (int b = 0; b < BOX; b++) {
+            int line[BOX];
+            for (int k = 0; k < BOX; k++) line[k] = k;
+            shuffle(line, BOX, &gen->rng);
+            for (int k = 0; k < BOX; k++) map[axis][b*BOX + k] = band[b]*BOX + line[k];
+        }
+    }
+    bool transpose = rng_next(&gen->rng) >> 63;
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++) {
+            int v = digit[src[map[0][r]][map[1][c]]];
+            if (transpose) dst[c][r] = v; else dst[r][c] = v;
+        }
+}
+
+// The generator's budget, or NULL when it sets no limit so calls skip the clock.
+static Budget *gen_budget(Generator *gen) {
+    return gen->budget.max_nodes || gen->budget.max_seconds ? &gen->budget : NULL;
+}
+
+bool gen_grid(Generator *gen, int grid[N][N]) {
+    STAT_START(t0);
+    STAT_INC(grids);
+    if (gen->pending > 0) {
+        gen->pending--;
+        transform_grid(gen, gen->base, grid);
+        STAT_STOP(generate_ns, t0);
+        return true;
+    }
+    dlx_reset(gen->dlx);
+    int found = search(gen->dlx, &gen->rng, gen_budget(gen));
+    if (found == BUDGET_EXCEEDED) gen->dropped++;
+    bool ok = found > 0;
+    if (ok) extract(gen->dlx, grid);
+    if (ok && gen->transforms > 0) {
+        memcpy(gen->base, grid, sizeof(gen->base));
+        gen->pending = gen->transforms;
+        gen->base_group = gen->want_group;
+        if (gen->want_group) {
+            // Every grid of a seeked group is a transform drawn from its index's stream.
+            gen->want_group = 0;
+            rng_seed(&gen->rng, gen->seed, gen->index);
+            gen->pending--;
+            transform_grid(gen, gen->base, grid);
+        }
+    }
+    STAT_STOP(generate_ns, t0);
+    return ok;
+}
+
+static inline void apply_cell(DLX *dlx, int g[N][N], int i) { apply_clue(dlx, i/N, i%N, g[i/N][i%N]-1); }
+static inline void remove_cell(DLX *dlx, int g[N][N], int i) { remove_clue(dlx, i/N, i%N, g[i/N][i%N]-1); }
+
+// Removes the clues of puzzle in random order, keeping each one whose removal
+// would allow another solution or whose check exceeds the budget. With a
+// meter, stops early once it is spent and keeps the clues not yet tried.
+static int carve_greedy(Generator *gen, int full[N][N], int puzzle[N][N], Meter *m) {
+    int pos[CELLS], n = 0;
+    for (int i = 0; i < CELLS; i++) if (puzzle[i/N][i%N]) pos[n++] = i;
+    shuffle(pos, n, &gen->rng);
+
+    int clues = n;
+    for (int k = 0; k < n; k++) {
+        if (m && meter_spent(m, gen->nodes)) break;
+        STAT_START(t0);
+        int r = pos[k]/N, c = pos[k]%N;
+        puzzle[r][c] = 0;
+        int alt = bits_has_alternative(puzzle, pos[k], full[r][c]-1, &gen->nodes, gen_budget(gen));
+        if (alt == BUDGET_EXCEEDED) gen->dropped++;
+        if (alt) puzzle[r][c] = full[r][c];
         else clues--;
+        STAT_INC(carve_steps);
+        STAT_STOP(carve_step_ns, t0);
+    }
+    return clues;
+}
+
+int gen_puzzle(Generator *gen, int full[N][N], int puzzle[N][N]) {
+    DLX *dlx = gen->dlx;
+    for (int i = 0; i < CELLS; i++) puzzle[i/N][i%N] = full[i/N][i%N];
+    if (gen->engine == ENGINE_BITS) return carve_greedy(gen, full, puzzle, NULL);
+
+    int pos[CELLS]; for (int i = 0; i < CELLS; i++) pos[i] = i;
+    shuffle(pos, CELLS, &gen->rng);
+
+    // Covers must be undone in LIFO order, so untested clues are stacked with the
+    // next candidate on top and the kept clues are re-covered above it per test.
+    dlx_reset(dlx);
+    for (int i = CELLS-1; i >= 0; i--) apply_cell(dlx, full, pos[i]);
+
+    int kept[CELLS], nk = 0;
+    int clues = CELLS;
+
+    for (int i = 0; i < CELLS; i++) {
+        STAT_START(t0);
+        remove_cell(dlx, full, pos[i]);
+        for (int k = 0; k < nk; k++) apply_cell(dlx, full, kept[k]);
+
+        int found = count(dlx, 2, gen_budget(gen));
+
+        for (int k = nk-1; k >= 0; k--) remove_cell(dlx, full, kept[k]);
+        if (found == BUDGET_EXCEEDED) gen->dropped++;
+        if (found >= 2 || found == BUDGET_EXCEEDED) kept[nk++] = pos[i];
+        else { puzzle[pos[i]/N][pos[i]%N] = 0; clues--; }
+        STAT_INC(carve_steps);
+        STAT_STOP(carve_step_ns, t0);
     }
 
-    dlx_destroy(dlx);
     return clues;
 }
 
-static void pretty(int g[9][9]) {
-    for (int r = 0; r < 9; r++) {
-        if (r && r%3 == 0) printf("------+-------+------\n");
-        for (int c = 0; c < 9; c++) {
-            if (c && c%3 == 0) printf("| ");
-            printf("%c ", g[r][c] ? '0'+g[r][c] : '.');
+// Target-clue carving: after one greedy pass, repeatedly put back a few of the
+// removed clues at random and carve greedily again in a fresh order, keeping
+// the result whenever it has no more clues than the best so far. The grid and
+// the best minimal puzzle carry over between rounds, so a round retests only
+// the remaining clues plus the restored ones instead of every cell. A budget
+// bounds the whole call, carving included; once it is spent the best puzzle
+// so far is returned and the budget reports exceeded.
+#define TARGET_RESTORE 5
+#define TARGET_ROUNDS 200
+
+int gen_puzzle_target(Generator *gen, int full[N][N], int puzzle[N][N], int max_clues, Budget *budget) {
+    Meter m = meter_begin(budget, gen->nodes);
+    Meter *mp = budget ? &m : NULL;
+    int best[N][N];
+    memcpy(best, full, sizeof(best));
+    int clues = carve_greedy(gen, full, best, mp);
+
+    for (int round = 0; round < TARGET_ROUNDS && clues > max_clues; round++) {
+        if (mp && meter_spent(mp, gen->nodes)) break;
+        int holes[CELLS], h = 0;
+        memcpy(puzzle, best, sizeof(best));
+        for (int i = 0; i < CELLS; i++) if (!puzzle[i/N][i%N]) holes[h++] = i;
+        shuffle(holes, h, &gen->rng);
+        for (int k = 0; k < TARGET_RESTORE && k < h; k++) puzzle[holes[k]/N][holes[k]%N] = full[holes[k]/N][holes[k]%N];
+
+        int n = carve_greedy(gen, full, puzzle, mp);
+        if (n <= clues) { clues = n; memcpy(best, puzzle, sizeof(best)); }
+    }
+    memcpy(puzzle, best, sizeof(best));
+    meter_end(&m, gen->nodes, 0);
+    return clues;
+}
+
+// The one-shot calls number themselves from a shared counter, so call k
+// after sudoku_seed(s) is puzzle k of seed s.
+static uint64_t api_seed;
+static atomic_uint_fast64_t api_calls;
+
+void sudoku_seed(uint64_t seed) {
+    api_seed = seed;
+    atomic_store(&api_calls, 0);
+}
+
+static Generator *api_generator(void) {
+    Generator *gen = gen_create(api_seed);
+    gen_seek(gen, atomic_fetch_add(&api_calls, 1));
+    return gen;
+}
+
+bool sudoku_generate(int grid[N][N]) {
+    Generator *gen = api_generator();
+    bool ok = gen_grid(gen, grid);
+    gen_destroy(gen);
+    return ok;
+}
+
+int sudoku_create_puzzle(int full[N][N], int puzzle[N][N]) {
+    Generator *gen = api_generator();
+    int clues = gen_puzzle(gen, full, puzzle);
+    gen_destroy(gen);
+    return clues;
+}
+
+// Canonical form: the lexicographically smallest row-major string over
+// transposition, band/stack and row/column permutations, with digits relabeled
+// in order of first appearance. Blanks sort after every digit so rows with
+// clues come first. Only arrangements whose per-line clue counts form the
+// largest sequence (bands by their sorted counts, lines descending within a
+// band) are considered; that choice is itself invariant and removes most ties.
+// Cells are fixed one at a time and a branch is dropped as soon as its prefix
+// is larger than the best one so far.
+#define CANON_BLANK (N + 1)
+#define CANON_INF (N + 2)
+
+// Rows or columns: clue count per line, each band's counts sorted
+// descending, and the count sequence every arrangement has to follow.
+typedef struct {
+    uint8_t clues[N], band[BOX][BOX], target[N];
+    uint8_t order[N];
+    bool used[N];
+} CanonAxis;
+
+typedef struct {
+    uint8_t g[N][N];
+    uint8_t best[CELLS];
+    CanonAxis row, col;
+} Canon;
+
+typedef struct { uint8_t map[N+1], next; } Labels;
+
+static inline int canon_value(Labels *lb, int d) {
+    if (!d) return CANON_BLANK;
+    if (!lb->map[d]) lb->map[d] = ++lb->next;
+    return lb->map[d];
+}
+
+static inline bool canon_cmp(Canon *cn, int p, int v) {
+    if (v > cn->best[p]) return false;
+    if (v < cn->best[p]) { cn->best[p] = v; memset(cn->best + p + 1, CANON_INF, CELLS - 1 - p); }
+    return true;
+}
+
+// Bands are ordered by their sorted counts, largest first, and lines
+// by count within a band; that is the largest sequence reachable.
+static void canon_axis(CanonAxis *ax) {
+    int order[BOX];
+    for (int b = 0; b < BOX; b++) {
+        order[b] = b;
+        memcpy(ax->band[b], ax->clues + b*BOX, BOX);
+        for (int i = 1; i < BOX; i++)
+            for (int j = i; j > 0 && ax->band[b][j] > ax->band[b][j-1]; j--) { uint8_t t = ax->band[b][j]; ax->band[b][j] = ax->band[b][j-1]; ax->band[b][j-1] = t; }
+    }
+    for (int i = 1; i < BOX; i++)
+        for (int j = i; j > 0 && memcmp(ax->band[order[j]], ax->band[order[j-1]], BOX) > 0; j--) { int t = order[j]; order[j] = order[j-1]; order[j-1] = t; }
+    for (int b = 0; b < BOX; b++) memcpy(ax->target + b*BOX, ax->band[order[b]], BOX);
+    memset(ax->used, 0, sizeof(ax->used));
+}
+
+// Line k of the order may open any unused band whose counts match the
+// target, or continue the band chosen at k-1. Either way every partial
+// arrangement extends to a full one, which the pruning in canon_cmp needs.
+static inline bool canon_allowed(const CanonAxis *ax, int k, int x) {
+    if (ax->used[x] || ax->clues[x] != ax->target[k]) return false;
+    if (k % BOX) return x/BOX == ax->order[k-1]/BOX;
+    return !ax->used[x/BOX*BOX] && !memcmp(ax->band[x/BOX], ax->target + k, BOX);
+}
+
+static void canon_rows(Canon *cn, int i, Labels lb) {
+    if (i == N) return;
+    for (int r = 0; r < N; r++) {
+        if (!canon_allowed(&cn->row, i, r)) continue;
+        Labels next = lb;
+        int k = 0;
+        while (k < N && canon_cmp(cn, i*N + k, canon_value(&next, cn->g[r][cn->col.order[k]]))) k++;
+        if (k < N) continue;
+        cn->row.order[i] = r;
+        cn->row.used[r] = true;
+        canon_rows(cn, i + 1, next);
+        cn->row.used[r] = false;
+    }
+}
+
+static void canon_cols(Canon *cn, int k, Labels lb) {
+    if (k == N) { canon_rows(cn, 1, lb); return; }
+    for (int c = 0; c < N; c++) {
+        if (!canon_allowed(&cn->col, k, c)) continue;
+        Labels next = lb;
+        if (!canon_cmp(cn, k, canon_value(&next, cn->g[cn->row.order[0]][c]))) continue;
+        cn->col.order[k] = c;
+        cn->col.used[c] = true;
+        canon_cols(cn, k + 1, next);
+        cn->col.used[c] = false;
+    }
+}
+
+void sudoku_canonical(int puzzle[N][N], int out[N][N]) {
+    CanonAxis rows, cols;
+    memset(&rows, 0, sizeof(rows));
+    memset(&cols, 0, sizeof(cols));
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++)
+            if (puzzle[r][c]) { rows.clues[r]++; cols.clues[c]++; }
+    canon_axis(&rows);
+    canon_axis(&cols);
+    int order = memcmp(rows.target, cols.target, N);
+
+    Canon cn;
+    memset(cn.best, CANON_INF, sizeof(cn.best));
+    for (int t = 0; t < 2; t++) {
+        if ((t == 0 && order < 0) || (t == 1 && order > 0)) continue;
+        for (int r = 0; r < N; r++)
+            for (int c = 0; c < N; c++) cn.g[r][c] = t ? puzzle[c][r] : puzzle[r][c];
+        cn.row = t ? cols : rows;
+        cn.col = t ? rows : cols;
+        for (int r = 0; r < N; r++) {
+            if (!canon_allowed(&cn.row, 0, r)) continue;
+            Labels lb = {{0}, 0};
+            cn.row.order[0] = r;
+            cn.row.used[r] = true;
+            canon_cols(&cn, 0, lb);
+            cn.row.used[r] = false;
+        }
+    }
+    for (int i = 0; i < CELLS; i++) out[i/N][i%N] = cn.best[i] == CANON_BLANK ? 0 : cn.best[i];
+}
+
+// Concurrent set of canonical forms, packed DEDUP_BITS per cell. The table is
+// split into stripes by hash, each with its own lock; a stripe doubles once
+// it is 70% full, since hashes need not spread evenly across stripes.
+#define DEDUP_STRIPES 64
+#define DEDUP_BITS (N < 16 ? 4 : 5)
+#define DEDUP_KEY ((CELLS * DEDUP_BITS + 7) / 8)
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint8_t (*keys)[DEDUP_KEY];
+    uint64_t *hash;
+    bool *used;
+    size_t mask, count;
+} DedupStripe;
+
+typedef struct { DedupStripe stripe[DEDUP_STRIPES]; } DedupSet;
+
+static DedupSet *dedup_create(long capacity) {
+    DedupSet *set = malloc(sizeof(DedupSet));
+    size_t n = 16;
+    while (n < (size_t)(2 * capacity / DEDUP_STRIPES + 1)) n <<= 1;
+    for (int s = 0; s < DEDUP_STRIPES; s++) {
+        DedupStripe *st = &set->stripe[s];
+        pthread_mutex_init(&st->lock, NULL);
+        st->keys = malloc(n * DEDUP_KEY);
+        st->hash = malloc(n * sizeof(uint64_t));
+        st->used = calloc(n, sizeof(bool));
+        st->mask = n - 1;
+        st->count = 0;
+    }
+    return set;
+}
+
+static size_t dedup_slot(const DedupStripe *st, uint64_t h) { return (h / DEDUP_STRIPES) & st->mask; }
+
+static void dedup_grow(DedupStripe *st) {
+    DedupStripe old = *st;
+    size_t n = 2 * (old.mask + 1);
+    st->keys = malloc(n * DEDUP_KEY);
+    st->hash = malloc(n * sizeof(uint64_t));
+    st->used = calloc(n, sizeof(bool));
+    st->mask = n - 1;
+    for (size_t i = 0; i <= old.mask; i++) {
+        if (!old.used[i]) continue;
+        size_t slot = dedup_slot(st, old.hash[i]);
+        while (st->used[slot]) slot = (slot + 1) & st->mask;
+        memcpy(st->keys[slot], old.keys[i], DEDUP_KEY);
+        st->hash[slot] = old.hash[i];
+        st->used[slot] = true;
+    }
+    free(old.keys);
+    free(old.hash);
+    free(old.used);
+}
+
+static void dedup_destroy(DedupSet *set) {
+    for (int s = 0; s < DEDUP_STRIPES; s++) {
+        pthread_mutex_destroy(&set->stripe[s].lock);
+        free(set->stripe[s].keys);
+        free(set->stripe[s].hash);
+        free(set->stripe[s].used);
+    }
+    free(set);
+}
+
+// Returns false if an equivalent puzzle was already inserted.
+static bool dedup_insert(DedupSet *set, int puzzle[N][N]) {
+    int canon[N][N];
+    uint8_t key[DEDUP_KEY + 1] = {0};
+    sudoku_canonical(puzzle, canon);
+    for (int i = 0; i < CELLS; i++) {
+        int bit = i * DEDUP_BITS;
+        unsigned v = canon[i/N][i%N] << bit % 8;
+        key[bit/8] |= v;
+        key[bit/8 + 1] |= v >> 8;
+    }
+
+    uint64_t h = 14695981039346656037ull;
+    for (int i = 0; i < DEDUP_KEY; i++) h = (h ^ key[i]) * 1099511628211ull;
+    DedupStripe *st = &set->stripe[h % DEDUP_STRIPES];
+
+    pthread_mutex_lock(&st->lock);
+    if (10 * (st->count + 1) > 7 * (st->mask + 1)) dedup_grow(st);
+    size_t slot = dedup_slot(st, h);
+    while (st->used[slot] && memcmp(st->keys[slot], key, DEDUP_KEY)) slot = (slot + 1) & st->mask;
+    bool fresh = !st->used[slot];
+    if (fresh) {
+        memcpy(st->keys[slot], key, DEDUP_KEY);
+        st->hash[slot] = h;
+        st->used[slot] = true;
+        st->count++;
+    }
+    pthread_mutex_unlock(&st->lock);
+    return fresh;
+}
+
+// Digits past 9 are written as letters, as in the usual 16x16 and 25x25 files.
+static const char SYMBOLS[] = ".123456789ABCDEFGHIJKLMNOP";
+
+static void format_line(int g[N][N], char *out) {
+    for (int i = 0; i < CELLS; i++) out[i] = SYMBOLS[g[i/N][i%N]];
+    out[CELLS] = '\n';
+}
+
+static void parse_line(const char *line, int g[N][N]) {
+    for (int i = 0; i < CELLS; i++) {
+        const char *p = line[i] ? strchr(SYMBOLS + 1, line[i]) : NULL;
+        g[i/N][i%N] = p && p - SYMBOLS <= N ? p - SYMBOLS : 0;
+    }
+}
+
+static void pretty(int g[N][N]) {
+    for (int r = 0; r < N; r++) {
+        if (r && r%BOX == 0) {
+            for (int c = 0; c < N; c++) printf(c && c%BOX == 0 ? "+-%s" : "%s", c == N-1 ? "-\n" : "--");
+        }
+        for (int c = 0; c < N; c++) {
+            if (c && c%BOX == 0) printf("| ");
+            printf("%c ", SYMBOLS[g[r][c]]);
         }
         printf("\n");
     }
 }
 
-int main(void) {
-    srand(time(NULL));
-    int full[9][9], puzzle[9][9];
+#define BATCH_LINES 256
+#define BATCH_MAX_DROPS 1000
+#define BATCH_MAX_TARGET_GRIDS 1000
+
+// Fewest clues a unique puzzle can have: known for 4x4 and 9x9, only the
+// trivial bound (every digit but one must appear) for larger boards.
+#define MIN_CLUES (BOX == 2 ? 4 : BOX == 3 ? 17 : N - 1)
+
+// Below FEW_CLUES, target carving slows down sharply: one clue lower takes
+// seconds per puzzle, and each further clue makes a grid that gets there
+// several times rarer. So a puzzle gets BATCH_TARGET_SECONDS before the run
+// gives up, a quarter of that for every clue past the first below FEW_CLUES
+// (but at least a second); otherwise K=17 would spend minutes per puzzle.
+#define FEW_CLUES (BOX == 2 ? 4 : BOX == 3 ? 20 : BOX == 4 ? 86 : 300)
+#define BATCH_TARGET_SECONDS 60.0
+
+static double target_seconds(int max_clues) {
+    double seconds = BATCH_TARGET_SECONDS;
+    for (int k = max_clues; k < FEW_CLUES - 1 && seconds > 1; k++) seconds /= 4;
+    return seconds > 1 ? seconds : 1;
+}
+
+// Puzzle i of the batch is puzzle first+i of the seed's stream. Chunks are
+// written in index order, so the output does not depend on the thread count.
+// A worker that gives up sets error; the others stop at their next puzzle.
+typedef struct {
+    long count;
+    long next, written;
+    uint64_t seed, first;
+    Engine engine;
+    int transforms, max_clues;
+    DedupSet *dedup;
+    bool binary;
+    Budget budget;
+    long dropped;
+    const char *error;
+    FILE *out;
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+} Batch;
+
+static void batch_fail(Batch *b, const char *error) {
+    pthread_mutex_lock(&b->lock);
+    if (!b->error) b->error = error;
+    pthread_cond_broadcast(&b->turn);
+    pthread_mutex_unlock(&b->lock);
+}
+
+static bool batch_failed(Batch *b) {
+    pthread_mutex_lock(&b->lock);
+    bool failed = b->error != NULL;
+    pthread_mutex_unlock(&b->lock);
+    return failed;
+}
+
+static void *batch_worker(void *arg) {
+    Batch *b = arg;
+    Generator *gen = gen_create(b->seed);
+    gen->engine = b->engine;
+    gen->transforms = b->transforms;
+    gen->budget = b->budget;
+
+    size_t rec = b->binary ? PUZZLE_RECORD : CELLS + 1;
+    char *buf = malloc(BATCH_LINES * rec), line[CELLS + 1];
+    int full[N][N], puzzle[N][N];
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        long start = b->next;
+        long n = b->count - start < BATCH_LINES ? b->count - start : BATCH_LINES;
+        b->next += n;
+        pthread_mutex_unlock(&b->lock);
+        if (n <= 0) break;
+
+        bool failed = false;
+        for (long i = 0; i < n && !failed; i++) {
+            STAT_SNAPSHOT(before);
+            gen_seek(gen, b->first + start + i);
+            int grid_drops = 0, target_misses = 0;
+            double target_end = b->max_clues ? bench_now() + target_seconds(b->max_clues) : 0;
+            for (;;) {
+                if (batch_failed(b)) { failed = true; break; }
+                if (!gen_grid(gen, full)) {
+                    if (++grid_drops > BATCH_MAX_DROPS) {
+                        batch_fail(b, "every grid search exceeds the budget; raise --max-nodes or --max-ms");
+                        failed = true;
+                        break;
+                    }
+                    continue;
+                }
+                grid_drops = 0;
+                if (b->max_clues) {
+                    Budget left = { .max_seconds = target_end - bench_now() };
+                    if (left.max_seconds <= 0 ||
+                        gen_puzzle_target(gen, full, puzzle, b->max_clues, &left) > b->max_clues) {
+                        if (left.max_seconds <= 0 || left.exceeded || ++target_misses > BATCH_MAX_TARGET_GRIDS) {
+                            batch_fail(b, "no grid carves down to --max-clues in time; raise K");
+                            failed = true;
+                            break;
+                        }
+                        continue;
+                    }
+                } else {
+                    gen_puzzle(gen, full, puzzle);
+                }
+                if (!b->dedup || dedup_insert(b->dedup, puzzle)) break;
+            }
+            if (failed) break;
+            if (b->binary) {
+                format_line(puzzle, line);
+                puzzle_pack(line, (uint8_t *)buf + i*rec);
+            } else {
+                format_line(puzzle, buf + i*rec);
+            }
+            STAT_PUZZLE(before, b->binary ? line : buf + i*rec);
+        }
+        pthread_mutex_lock(&b->lock);
+        while (b->written != start && !b->error) pthread_cond_wait(&b->turn, &b->lock);
+        if (b->error) {
+            pthread_mutex_unlock(&b->lock);
+            break;
+        }
+        fwrite(buf, rec, n, b->out);
+        b->written += n;
+        pthread_cond_broadcast(&b->turn);
+        pthread_mutex_unlock(&b->lock);
+    }
+
+    pthread_mutex_lock(&b->lock);
+    b->dropped += gen->dropped;
+    pthread_mutex_unlock(&b->lock);
+    free(buf);
+    gen_destroy(gen);
+    STAT_MERGE();
+    return NULL;
+}
+
+// Returns false, after reporting why, if a worker gave up.
+static bool run_batch(long count, long first, int threads, uint64_t seed, Engine engine, int transforms, int max_clues, bool dedup,
+                      bool binary, Budget budget) {
+    Batch b = { .count = count, .next = 0, .written = 0, .seed = seed, .first = first, .engine = engine, .transforms = transforms, .max_clues = max_clues,
+                .binary = binary, .budget = budget, .out = stdout };
+    b.dedup = dedup ? dedup_create(count) : NULL;
+    if (binary) {
+        uint8_t hdr[PUZZLE_HEADER];
+        puzzle_header(hdr);
+        fwrite(hdr, 1, sizeof(hdr), b.out);
+    }
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.turn, NULL);
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&tids[t], NULL, batch_worker, &b);
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+    free(tids);
+    pthread_mutex_destroy(&b.lock);
+    pthread_cond_destroy(&b.turn);
+    if (b.dedup) dedup_destroy(b.dedup);
+    fflush(b.out);
+    if (b.dropped) fprintf(stderr, "%ld searches exceeded the budget\n", b.dropped);
+    if (b.error) fprintf(stderr, "%s\n", b.error);
+    return !b.error;
+}
+
+// Prints the number of solutions (0, 1, or 2 for several) of each puzzle line
+// on stdin, splitting each search across the worker threads. A search that
+// exceeds the budget prints "?" with the nodes and time it used.
+static void run_check(int threads, Budget budget) {
+    char line[CELLS + 256];
+    int puzzle[N][N];
+    bool limited = budget.max_nodes || budget.max_seconds;
+    while (fgets(line, sizeof(line), stdin)) {
+        if (strcspn(line, "\n") < CELLS) continue;
+        parse_line(line, puzzle);
+        int found = sudoku_count_solutions_parallel(puzzle, 2, threads, limited ? &budget : NULL);
+        if (found == BUDGET_EXCEEDED) printf("? %ld nodes %.3fms\n", budget.nodes, budget.seconds * 1000);
+        else printf("%d\n", found);
+    }
+    fflush(stdout);
+}
+
+#define BENCH_TRANSFORMS 15
+
+static void run_bench(long n, uint64_t seed, const char *json_path) {
+    FILE *json = json_path ? fopen(json_path, "w") : NULL;
+    if (json_path && !json) perror(json_path);
+    int first = 1;
+    bench_begin(json, "generator");
+
+    int (*grids)[N][N] = malloc(n * sizeof(*grids));
+    int puzzle[N][N];
+    BenchSeries series = {0};
+
+    Generator *gen = gen_create(seed);
+    for (long i = 0; i < n; i++) {
+        long nodes = gen->dlx->nodes;
+        double t = bench_now();
+        gen_grid(gen, grids[i]);
+        bench_add(&series, bench_now() - t, gen->dlx->nodes - nodes);
+    }
+    bench_report(json, &first, "generate", &series);
+
+    gen->transforms = BENCH_TRANSFORMS;
+    for (long i = 0; i < n; i++) {
+        long nodes = gen->dlx->nodes;
+        double t = bench_now();
+        gen_grid(gen, puzzle);
+        bench_add(&series, bench_now() - t, gen->dlx->nodes - nodes);
+    }
+    bench_report(json, &first, "generate_xform", &series);
+    gen->transforms = gen->pending = 0;
+
+    const struct { const char *name; Engine engine; } carvers[] = { { "carve", ENGINE_BITS }, { "carve_dlx", ENGINE_DLX } };
+    for (int k = 0; k < 2; k++) {
+        gen_seek(gen, 0);
+        gen->engine = carvers[k].engine;
+        for (long i = 0; i < n; i++) {
+            long nodes = gen->nodes + gen->dlx->nodes;
+            double t = bench_now();
+            gen_puzzle(gen, grids[i], puzzle);
+            bench_add(&series, bench_now() - t, gen->nodes + gen->dlx->nodes - nodes);
+        }
+        bench_report(json, &first, carvers[k].name, &series);
+    }
+    gen_destroy(gen);
+    free(grids);
+
+    bench_end(json);
+    if (json) fclose(json);
+}
+
+int main(int argc, char **argv) {
+    long count = 0, first = 0, bench = 0;
+    const char *json = NULL;
+    int threads = 1, transforms = 0, max_clues = 0;
+    bool dedup = false, binary = false, check = false;
+    const char *stats_file = NULL, *lines_file = NULL;
+    Budget budget = {0};
+    uint64_t seed = time(NULL);
+    Engine engine = ENGINE_BITS;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--count") && i+1 < argc) count = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && i+1 < argc) threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--seed") && i+1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (!strcmp(argv[i], "--start") && i+1 < argc) first = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--engine") && i+1 < argc) engine = strcmp(argv[++i], "dlx") ? ENGINE_BITS : ENGINE_DLX;
+        else if (!strcmp(argv[i], "--transforms") && i+1 < argc) transforms = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--max-clues") && i+1 < argc) max_clues = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--dedup")) dedup = true;
+        else if (!strcmp(argv[i], "--binary")) binary = true;
+        else if (!strcmp(argv[i], "--check")) check = true;
+        else if (!strcmp(argv[i], "--max-nodes") && i+1 < argc) budget.max_nodes = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--max-ms") && i+1 < argc) budget.max_seconds = atof(argv[++i]) / 1000;
+        else if (!strcmp(argv[i], "--bench") && i+1 < argc) bench = atol(argv[++i]);
+        else if (!strcmp(argv[i], "--json") && i+1 < argc) json = argv[++i];
+        else if (!strcmp(argv[i], "--stats") && i+1 < argc) stats_file = argv[++i];
+        else if (!strcmp(argv[i], "--stats-lines") && i+1 < argc) lines_file = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--count N] [--start I] [--threads T] [--seed S] [--engine dlx|bits] [--transforms N] [--max-clues K (bits engine only)] [--dedup] [--binary] [--check] [--max-nodes N] [--max-ms MS] [--bench N [--json FILE]] [--stats FILE] [--stats-lines FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (max_clues && max_clues < MIN_CLUES) {
+        fprintf(stderr, "--max-clues must be at least %d for %dx%d puzzles\n", MIN_CLUES, N, N);
+        return 1;
+    }
+    if (max_clues && max_clues < FEW_CLUES)
+        fprintf(stderr, "--max-clues %d is below %d, which few %dx%d grids carve down to; "
+                "each puzzle gets %.3gs before the run gives up\n", max_clues, FEW_CLUES, N, N, target_seconds(max_clues));
+    if (max_clues && engine == ENGINE_DLX)
+        fprintf(stderr, "--max-clues always carves with the bits engine; ignoring --engine dlx\n");
+    if (binary && N != 9) {
+        fprintf(stderr, "--binary only supports 9x9 puzzles\n");
+        return 1;
+    }
+#ifdef STATS
+    stats_path = stats_file;
+    if (lines_file && !(stats_lines = fopen(lines_file, "w"))) { perror(lines_file); return 1; }
+    atexit(stats_finish);
+#else
+    if (stats_file || lines_file) {
+        fprintf(stderr, "--stats needs a build with -DSTATS (make stats)\n");
+        return 1;
+    }
+#endif
+
+    if (bench > 0) {
+        run_bench(bench, seed, json);
+        return 0;
+    }
+
+    if (check) {
+        run_check(threads, budget);
+        return 0;
+    }
+
+    if (count > 0) {
+        return run_batch(count, first, threads, seed, engine, transforms, max_clues, dedup, binary, budget) ? 0 : 1;
+    }
+
+    sudoku_seed(seed);
+    int full[N][N], puzzle[N][N];
 
+    STAT_SNAPSHOT(before);
     sudoku_generate(full);
     int clues = sudoku_create_puzzle(full, puzzle);
 
@@ -231,7 +1595,8 @@ int main(void) {
     pretty(full);
     printf("\nPuzzle (%d clues):\n", clues);
     pretty(puzzle);
-    for (int i = 0; i < 81; i++)
-        putchar(puzzle[i/9][i%9] ? '0' + puzzle[i/9][i%9] : '.');
-    putchar('\n');
+    char line[CELLS + 1];
+    format_line(puzzle, line);
+    fwrite(line, 1, CELLS + 1, stdout);
+    STAT_PUZZLE(before, line);
 }
@@ -2,33 +2,111 @@
 #define DLX_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
-typedef struct Node Node;
-typedef struct ColumnHeader ColumnHeader;
+// Box side length, fixed at compile time: 3 for 9x9, 4 for 16x16, 5 for 25x25.
+#ifndef BOX
+#define BOX 3
+#endif
+#if BOX < 2 || BOX > 5
+#error "BOX must be between 2 and 5"
+#endif
 
-struct Node {
-    Node *left, *right, *up, *down;
-    ColumnHeader *column;
-    int row_id;
-};
+#define DLX_N (BOX * BOX)
+#define DLX_CELLS (DLX_N * DLX_N)
+#define DLX_COLS (4 * DLX_CELLS)
+#define DLX_ROWS (DLX_CELLS * DLX_N)
+#define DLX_NODES (1 + DLX_COLS + DLX_ROWS * 4)
+#define DLX_BUCKETS (DLX_N + 1)
+#define DLX_DEPTH DLX_CELLS
+#define DLX_BRANCH DLX_N
 
-struct ColumnHeader {
-    Node node;
-    int size;
-};
+// One open level of the search walk: the covered column and its rows.
+typedef struct {
+    uint16_t col;
+    uint8_t n, next;
+    uint16_t rows[DLX_BRANCH];
+} DLXLevel;
 
+// Node 0 is the root (25x25 still fits the uint16_t indices), 1..DLX_COLS are column headers, the rest are row nodes.
+// Uncovered columns are also chained by size into DLX_BUCKETS lists whose
+// heads follow the column headers in bnext/bprev. The search walk keeps its
+// state in stack/depth so it can stop after any node and resume later.
+// dlx_reset copies every field before `stack` from a shared template.
 typedef struct {
-    ColumnHeader *root;
-    ColumnHeader **columns;
-    Node *all_nodes;
-    int *solution;
+    uint16_t left[DLX_NODES];
+    uint16_t right[DLX_NODES];
+    uint16_t up[DLX_NODES];
+    uint16_t down[DLX_NODES];
+    uint16_t col[DLX_NODES];
+    uint16_t row[DLX_NODES];
+    uint16_t size[DLX_COLS + 1];
+    uint16_t bnext[DLX_COLS + 1 + DLX_BUCKETS];
+    uint16_t bprev[DLX_COLS + 1 + DLX_BUCKETS];
+    DLXLevel stack[DLX_DEPTH];
+    int depth;
+    bool descend;
+    int solution[DLX_CELLS];
     int solutions_found;
+    long nodes;
 } DLX;
 
+typedef enum { ENGINE_DLX, ENGINE_BITS } Engine;
+
+// xoshiro256** state. Each generator owns one, so no call shares a lock.
+typedef struct {
+    uint64_t s[4];
+} Rng;
+
+// Limits for one search or count call (zero means unlimited). The call fills
+// in how far it got; calls that hit a limit return BUDGET_EXCEEDED.
+#define BUDGET_EXCEEDED -1
+
+typedef struct {
+    long max_nodes;
+    double max_seconds;
+    long nodes;
+    int solutions;
+    double seconds;
+    bool exceeded;
+} Budget;
+
+// With transforms > 0, each searched grid is followed by that many grids
+// derived from it by random relabeling, row/column/band/stack permutation
+// and transposition. gen_seek restarts the random stream at a puzzle index,
+// so what follows depends only on (seed, index); with transforms, each group
+// of transforms+1 indices derives its grids from one base grid searched on
+// the group's own stream. Every search and uniqueness check runs under budget: a
+// grid whose search exceeds it is dropped, and a clue whose check exceeds it
+// is kept, so puzzles stay unique but may not be minimal. Both are counted
+// in `dropped`.
+typedef struct {
+    DLX *dlx;
+    uint64_t seed, index;
+    Rng rng;
+    Engine engine;
+    long nodes;
+    int transforms, pending;
+    int base[DLX_N][DLX_N];
+    uint64_t base_group, want_group;
+    Budget budget;
+    long dropped;
+} Generator;
+
 DLX *dlx_create(void);
 void dlx_reset(DLX *dlx);
 void dlx_destroy(DLX *dlx);
-bool sudoku_generate(int grid[9][9]);
-int sudoku_create_puzzle(int full[9][9], int puzzle[9][9]);
+Generator *gen_create(uint64_t seed);
+void gen_destroy(Generator *gen);
+void gen_seek(Generator *gen, uint64_t index);
+bool gen_grid(Generator *gen, int grid[DLX_N][DLX_N]);
+int gen_puzzle(Generator *gen, int full[DLX_N][DLX_N], int puzzle[DLX_N][DLX_N]);
+int gen_puzzle_target(Generator *gen, int full[DLX_N][DLX_N], int puzzle[DLX_N][DLX_N], int max_clues, Budget *budget);
+int sudoku_count_solutions(int puzzle[DLX_N][DLX_N], int max);
+int sudoku_count_solutions_parallel(int puzzle[DLX_N][DLX_N], int max, int threads, Budget *budget);
+void sudoku_canonical(int puzzle[DLX_N][DLX_N], int out[DLX_N][DLX_N]);
+void sudoku_seed(uint64_t seed);
+bool sudoku_generate(int grid[DLX_N][DLX_N]);
+int sudoku_create_puzzle(int full[DLX_N][DLX_N], int puzzle[DLX_N][DLX_N]);
 
 #endif
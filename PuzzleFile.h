@@ -0,0 +1,66 @@
+#ifndef PUZZLE_FILE_H
+#define PUZZLE_FILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Binary puzzle file: an 8-byte header ("SDKP", version, record size, two
+// zero bytes) followed by fixed-size records, so record i starts at byte
+// PUZZLE_HEADER + i * PUZZLE_RECORD. Each record packs the 81 cells (0 for
+// blank) three at a time as a 10-bit value 0..999, low bits first.
+#define PUZZLE_MAGIC "SDKP"
+#define PUZZLE_VERSION 1
+#define PUZZLE_HEADER 8
+#define PUZZLE_RECORD 34
+
+static inline void puzzle_header(uint8_t *hdr) {
+    memcpy(hdr, PUZZLE_MAGIC, 4);
+    hdr[4] = PUZZLE_VERSION;
+    hdr[5] = PUZZLE_RECORD;
+    hdr[6] = hdr[7] = 0;
+}
+
+static inline bool puzzle_is_binary(const void *buf, size_t len) {
+    const uint8_t *h = buf;
+    return len >= PUZZLE_HEADER && !memcmp(h, PUZZLE_MAGIC, 4) && h[4] == PUZZLE_VERSION && h[5] == PUZZLE_RECORD;
+}
+
+// Three cells as text for every 10-bit value; out-of-range values are blank.
+static uint32_t puzzle_digits[1024];
+
+// Fills puzzle_digits; call once before the first puzzle_unpack.
+static inline void puzzle_init(void) {
+    for (unsigned v = 0; v < 1024; v++) {
+        unsigned w = v > 999 ? 0 : v, d[3] = { w / 100, w / 10 % 10, w % 10 };
+        char text[4] = {0};
+        for (int k = 0; k < 3; k++) text[k] = d[k] ? '0' + d[k] : '.';
+        memcpy(&puzzle_digits[v], text, 4);
+    }
+}
+
+// Packs an 81-character text line ('1'..'9', anything else is blank).
+static inline void puzzle_pack(const char *line, uint8_t *rec) {
+    memset(rec, 0, PUZZLE_RECORD);
+    for (int g = 0; g < 27; g++) {
+        unsigned v = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned d = (unsigned char)line[g*3 + k] - '0';
+            v = v*10 + (d - 1 < 9 ? d : 0);
+        }
+        int bit = g * 10;
+        rec[bit/8] |= v << (bit % 8);
+        rec[bit/8 + 1] |= v >> (8 - bit % 8);
+    }
+}
+
+// Writes the record back as 81 characters with '.' for blanks.
+static inline void puzzle_unpack(const uint8_t *rec, char *line) {
+    for (int g = 0; g < 27; g++) {
+        int bit = g * 10;
+        unsigned v = ((rec[bit/8] | rec[bit/8 + 1] << 8) >> (bit % 8)) & 1023;
+        memcpy(line + g*3, &puzzle_digits[v], g < 26 ? 4 : 3);
+    }
+}
+
+#endif
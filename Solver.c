@@ -1,181 +1,511 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Bench.h"
+#include "PuzzleFile.h"
+#include "Stats.h"
 
 typedef uint16_t u16;
 typedef uint8_t u8;
+typedef uint32_t u32;
 
-static u8 grid[81];
-static u16 cands[81];
-static u16 row_mask[9][9];
-static u16 col_mask[9][9];
-static u16 box_mask[9][9];
-static int unsolved;
+// Box side length, fixed at compile time: 3 for 9x9, 4 for 16x16, 5 for 25x25.
+#ifndef BOX
+#define BOX 3
+#endif
+#if BOX < 2 || BOX > 5
+#error "BOX must be between 2 and 5"
+#endif
 
-static u8 cell_box[81];
-static u8 cell_boxpos[81];
-static u8 cell_row[81];
-static u8 cell_col[81];
-static u8 peers[81][20];
-static u8 box_cell[9][9];
+#define N (BOX * BOX)
+#define CELLS (N * N)
+#define PEERS (3*N - 2*BOX - 1)
+#define ALL_DIGITS ((mask_t)((1u << N) - 1))
+#define UNIT_MASKS ((3*CELLS + 15) / 16 * 16)
+
+// One bit per digit or per unit position; trail entries hold a mask and its offset.
+#if N <= 16
+typedef uint16_t mask_t;
+typedef uint32_t trail_t;
+#else
+typedef uint32_t mask_t;
+typedef uint64_t trail_t;
+#endif
+#if CELLS <= 256
+typedef uint8_t cell_t;
+#else
+typedef uint16_t cell_t;
+#endif
+
+typedef struct {
+    u8 grid[CELLS];
+    mask_t cands[CELLS];
+    union {
+        struct {
+            mask_t row_mask[N][N];
+            mask_t col_mask[N][N];
+            mask_t box_mask[N][N];
+        };
+        mask_t unit_mask[UNIT_MASKS];
+    };
+    int unsolved;
+    long nodes;
+    trail_t *trail;
+    int trail_len;
+    mask_t (*changed)[N];
+} __attribute__((aligned(64))) SolverState;
+
+// While grading, `changed` collects the units whose masks change, per unit
+// type and digit: changed[UNIT_ROW][d] has bit r set if row_mask[d][r] did.
+enum { UNIT_ROW, UNIT_COL, UNIT_BOX };
+
+#define TRAIL_MAX (4 * CELLS * N)
+
+#ifdef STATS
+// Per-technique slots must match the techniques table (checked below it).
+#define STAT_TECHNIQUES 7
+
+typedef struct {
+    long puzzles, nodes, placements, eliminations, sweeps, propagate_ns;
+    long technique_calls[STAT_TECHNIQUES], technique_elims[STAT_TECHNIQUES];
+} Stats;
+
+static _Thread_local Stats stats;
+#endif
+
+static u8 cell_box[CELLS];
+static u8 cell_boxpos[CELLS];
+static u8 cell_row[CELLS];
+static u8 cell_col[CELLS];
+static cell_t peers[CELLS][PEERS];
+static cell_t box_cell[N][N];
+static mask_t box_seg[BOX], box_stride[BOX];
+
+// Digits past 9 are written as letters; any other character is a blank.
+static inline int symbol_value(char ch) {
+    if (ch >= '1' && ch <= '9') return ch - '0' <= N ? ch - '0' : 0;
+    return N > 9 && ch >= 'A' && ch < 'A' + N - 9 ? ch - 'A' + 10 : 0;
+}
+
+static inline char symbol(int v) {
+    return !v ? '.' : N <= 9 || v <= 9 ? '0' + v : 'A' + v - 10;
+}
+
+#if BOX == 3 || BOX == 4
+#define SIMD_UNITS 1
+static u16 digit_keep[CELLS][3][16] __attribute__((aligned(32)));
+static cell_t unit_cell[3*N][N];
+#endif
 
 static void init_tables(void) {
-    for (int i = 0; i < 81; i++) {
-        int r = i / 9, c = i % 9;
+    for (int i = 0; i < CELLS; i++) {
+        int r = i / N, c = i % N;
         cell_row[i] = r;
         cell_col[i] = c;
-        cell_box[i] = (r / 3) * 3 + c / 3;
-        cell_boxpos[i] = (r % 3) * 3 + c % 3;
+        cell_box[i] = (r / BOX) * BOX + c / BOX;
+        cell_boxpos[i] = (r % BOX) * BOX + c % BOX;
         
         int p = 0;
-        for (int cc = 0; cc < 9; cc++)
-            if (cc != c) peers[i][p++] = r * 9 + cc;
-        for (int rr = 0; rr < 9; rr++)
-            if (rr != r) peers[i][p++] = rr * 9 + c;
-        int br = (r / 3) * 3, bc = (c / 3) * 3;
-        for (int dr = 0; dr < 3; dr++)
-            for (int dc = 0; dc < 3; dc++) {
+        for (int cc = 0; cc < N; cc++)
+            if (cc != c) peers[i][p++] = r * N + cc;
+        for (int rr = 0; rr < N; rr++)
+            if (rr != r) peers[i][p++] = rr * N + c;
+        int br = (r / BOX) * BOX, bc = (c / BOX) * BOX;
+        for (int dr = 0; dr < BOX; dr++)
+            for (int dc = 0; dc < BOX; dc++) {
                 int rr = br + dr, cc = bc + dc;
-                if (rr != r && cc != c) peers[i][p++] = rr * 9 + cc;
+                if (rr != r && cc != c) peers[i][p++] = rr * N + cc;
             }
     }
-    for (int b = 0; b < 9; b++)
-        for (int bp = 0; bp < 9; bp++)
-            box_cell[b][bp] = (b/3)*27 + (bp/3)*9 + (b%3)*3 + bp%3;
+    for (int b = 0; b < N; b++)
+        for (int bp = 0; bp < N; bp++)
+            box_cell[b][bp] = (b/BOX)*BOX*N + (bp/BOX)*N + (b%BOX)*BOX + bp%BOX;
+
+    // Box rows as runs of BOX bits (also the stacks of a row or column mask),
+    // box columns as every BOX-th bit.
+    for (int k = 0; k < BOX; k++)
+        for (int j = 0; j < BOX; j++) {
+            box_seg[k] |= 1 << (k*BOX + j);
+            box_stride[k] |= 1 << (j*BOX + k);
+        }
+
+#ifdef SIMD_UNITS
+    // Placing d at i clears d from every unit mask covering i and its peers.
+    for (int i = 0; i < CELLS; i++) {
+        int r = cell_row[i], c = cell_col[i], b = cell_box[i];
+        for (int t = 0; t < 3; t++)
+            for (int u = 0; u < 16; u++) digit_keep[i][t][u] = 0xFFFF;
+        for (int u = 0; u < N; u++) {
+            digit_keep[i][0][u] = u == r ? 0 : ~(1 << c);
+            digit_keep[i][1][u] = u == c ? 0 : ~(1 << r);
+            digit_keep[i][2][u] = u == b ? 0 : 0xFFFF;
+        }
+        for (int p = 0; p < PEERS; p++) {
+            int j = peers[i][p];
+            digit_keep[i][0][cell_row[j]] &= ~(1 << cell_col[j]);
+            digit_keep[i][1][cell_col[j]] &= ~(1 << cell_row[j]);
+            digit_keep[i][2][cell_box[j]] &= ~(1 << cell_boxpos[j]);
+        }
+    }
+    // Cells of rows, then columns, then boxes, for the lane solver.
+    for (int u = 0; u < N; u++)
+        for (int k = 0; k < N; k++) {
+            unit_cell[u][k] = u * N + k;
+            unit_cell[N + u][k] = k * N + u;
+            unit_cell[2*N + u][k] = box_cell[u][k];
+        }
+#endif
+}
+
+// Trail entries pack a mask's offset within SolverState above its old value.
+// Every mask changes at most N times per search path, so TRAIL_MAX never overflows.
+#define MASK_BITS (8 * (int)sizeof(mask_t))
+
+static inline void trail_push(SolverState *st, mask_t *p, mask_t old) {
+    st->trail[st->trail_len++] = (trail_t)((char *)p - (char *)st) / sizeof(mask_t) << MASK_BITS | old;
+}
+
+static inline void set_mask(SolverState *st, mask_t *p, mask_t v) {
+    if (*p == v) return;
+    if (st->trail) trail_push(st, p, *p);
+    *p = v;
+}
+
+static void undo(SolverState *st, int mark) {
+    while (st->trail_len > mark) {
+        trail_t e = st->trail[--st->trail_len];
+        int off = e >> MASK_BITS;
+        mask_t old = (mask_t)e;
+        *(mask_t *)((char *)st + off * sizeof(mask_t)) = old;
+        int i = off - (int)(offsetof(SolverState, cands) / sizeof(mask_t));
+        if (old && i >= 0 && i < CELLS) st->grid[i] = 0;
+    }
+}
+
+static inline void mark_cell(SolverState *st, int i, int d) {
+    st->changed[UNIT_ROW][d] |= 1u << cell_row[i];
+    st->changed[UNIT_COL][d] |= 1u << cell_col[i];
+    st->changed[UNIT_BOX][d] |= 1u << cell_box[i];
+}
+
+// Placing d at i changes the units of i for each of its candidates, and for
+// d the units of every peer still holding it, which the masks for d list
+// before clear_digit empties them.
+static void mark_placement(SolverState *st, int i, int d) {
+    int r = cell_row[i], c = cell_col[i], b = cell_box[i];
+    int band = b / BOX, stack = b % BOX;
+    for (mask_t m = st->cands[i] & ~(1 << d); m; m &= m - 1)
+        mark_cell(st, i, __builtin_ctz(m));
+    mask_t rm = st->row_mask[d][r], cm = st->col_mask[d][c], bm = st->box_mask[d][b];
+    mask_t rows = 1u << r | cm, cols = 1u << c | rm, boxes = 1u << b;
+    for (int k = 0; k < BOX; k++) {
+        if (bm & box_seg[k]) rows |= 1u << (band*BOX + k);
+        if (bm & box_stride[k]) cols |= 1u << (stack*BOX + k);
+        if (rm & box_seg[k]) boxes |= 1u << (band*BOX + k);
+        if (cm & box_seg[k]) boxes |= 1u << (k*BOX + stack);
+    }
+    st->changed[UNIT_ROW][d] |= rows;
+    st->changed[UNIT_COL][d] |= cols;
+    st->changed[UNIT_BOX][d] |= boxes;
 }
 
-static inline int eliminate(int i, int d) {
-    u16 m = 1 << d;
-    u16 old = cands[i];
+// Only the grading techniques eliminate, so this always marks st->changed.
+static inline int eliminate(SolverState *st, int i, int d) {
+    mask_t m = 1 << d;
+    mask_t old = st->cands[i];
     if (!(old & m)) return -1;
+    STAT_INC(eliminations);
     
-    u16 rem = old ^ m;
-    cands[i] = rem;
+    mask_t rem = old ^ m;
+    set_mask(st, &st->cands[i], rem);
+    mark_cell(st, i, d);
     
     int r = cell_row[i], c = cell_col[i];
-    row_mask[d][r] &= ~(1 << c);
-    col_mask[d][c] &= ~(1 << r);
-    box_mask[d][cell_box[i]] &= ~(1 << cell_boxpos[i]);
+    set_mask(st, &st->row_mask[d][r], st->row_mask[d][r] & ~(1 << c));
+    set_mask(st, &st->col_mask[d][c], st->col_mask[d][c] & ~(1 << r));
+    set_mask(st, &st->box_mask[d][cell_box[i]], st->box_mask[d][cell_box[i]] & ~(1 << cell_boxpos[i]));
    
     if (!rem) return -2; 
     return (rem && !(rem & (rem-1))) ? i : -1;
 }
 
-static inline void place(int i, int d) {
-    int r = cell_row[i], c = cell_col[i], b = cell_box[i], bp = cell_boxpos[i];
-    
-    for (int dd = 0; dd < 9; dd++) {
-        row_mask[dd][r] &= ~(1 << c);
-        col_mask[dd][c] &= ~(1 << r);
-        box_mask[dd][b] &= ~(1 << bp);
-    }
-    
-    row_mask[d][r] = 0;
-    col_mask[d][c] = 0;
-    box_mask[d][b] = 0;
-    
-    grid[i] = d + 1;
-    cands[i] = 0;
-    unsolved--;
-    
-    int naked[20];
-    int nc = 0;
-    
-    for (int p = 0; p < 20; p++) {
-        int ns = eliminate(peers[i][p], d);
-        if (ns == -2) { unsolved = -1; return; } //Finishes the curr loop before the main function notices?
-        if (ns >= 0) naked[nc++] = ns;
+static void clear_digit_scalar(SolverState *st, int i, int d) {
+    set_mask(st, &st->row_mask[d][cell_row[i]], 0);
+    set_mask(st, &st->col_mask[d][cell_col[i]], 0);
+    set_mask(st, &st->box_mask[d][cell_box[i]], 0);
+    for (int p = 0; p < PEERS; p++) {
+        int j = peers[i][p];
+        if (!(st->cands[j] & (1 << d))) continue;
+        set_mask(st, &st->row_mask[d][cell_row[j]], st->row_mask[d][cell_row[j]] & ~(1 << cell_col[j]));
+        set_mask(st, &st->col_mask[d][cell_col[j]], st->col_mask[d][cell_col[j]] & ~(1 << cell_row[j]));
+        set_mask(st, &st->box_mask[d][cell_box[j]], st->box_mask[d][cell_box[j]] & ~(1 << cell_boxpos[j]));
     }
-    
-    for (int n = 0; n < nc; n++) {
-        if (!cands[naked[n]]) continue;
-        place(naked[n], __builtin_ctz(cands[naked[n]]));
+}
+
+static int hidden_singles_scalar(SolverState *st);
+static int lanes_on;
+static void (*clear_digit)(SolverState *st, int i, int d) = clear_digit_scalar;
+static int (*hidden_singles)(SolverState *st) = hidden_singles_scalar;
+
+// Places d at i, then every naked single that placement leaves behind. Pending
+// singles wait in a queue of cells; each cell enters it at most once, since a
+// second removal from a single empties it. The first empty cell sets unsolved
+// to -1 and abandons the rest of the queue. With track set (grading), every
+// placement is marked in st->changed.
+static inline __attribute__((always_inline)) void place_cell(SolverState *st, int i, int d, int track) {
+    cell_t queue[CELLS];
+    int head = 0, tail = 0;
+    for (;;) {
+        int r = cell_row[i], c = cell_col[i], b = cell_box[i], bp = cell_boxpos[i];
+        STAT_INC(placements);
+        if (track) mark_placement(st, i, d);
+
+        for (mask_t m = st->cands[i] & ~(1 << d); m; m &= m - 1) {
+            int dd = __builtin_ctz(m);
+            set_mask(st, &st->row_mask[dd][r], st->row_mask[dd][r] & ~(1 << c));
+            set_mask(st, &st->col_mask[dd][c], st->col_mask[dd][c] & ~(1 << r));
+            set_mask(st, &st->box_mask[dd][b], st->box_mask[dd][b] & ~(1 << bp));
+        }
+        clear_digit(st, i, d);
+
+        st->grid[i] = d + 1;
+        set_mask(st, &st->cands[i], 0);
+        st->unsolved--;
+
+        mask_t bit = 1 << d;
+        for (int p = 0; p < PEERS; p++) {
+            int j = peers[i][p];
+            mask_t old = st->cands[j];
+            if (!(old & bit)) continue;
+            STAT_INC(eliminations);
+            mask_t rem = old ^ bit;
+            set_mask(st, &st->cands[j], rem);
+            if (!rem) { st->unsolved = -1; return; }
+            if (!(rem & (rem-1))) queue[tail++] = j;
+        }
+
+        do {
+            if (head == tail) return;
+            i = queue[head++];
+        } while (!st->cands[i]);
+        d = __builtin_ctz(st->cands[i]);
     }
 }
 
-static void init_puzzle(const char *s) {
-    unsolved = 81;
+static inline void place(SolverState *st, int i, int d) { place_cell(st, i, d, 0); }
+static inline void place_tracked(SolverState *st, int i, int d) { place_cell(st, i, d, 1); }
+
+static void init_puzzle(SolverState *st, const char *s) {
+    st->unsolved = CELLS;
+    st->nodes = 0;
+    st->trail = NULL;
+    st->trail_len = 0;
+    st->changed = NULL;
     
-    memset(grid, 0, 81 * sizeof(u8));
-    for (int i = 0; i < 81; i++) cands[i] = 0x1FF;   
+    memset(st->grid, 0, CELLS * sizeof(u8));
+    memset(st->unit_mask, 0, sizeof(st->unit_mask));
+    for (int i = 0; i < CELLS; i++) st->cands[i] = ALL_DIGITS;   
  
-    for (int d = 0; d < 9; d++) {
-        for (int u = 0; u < 9; u++) {
-            row_mask[d][u] = 0x1FF;
-            col_mask[d][u] = 0x1FF;
-            box_mask[d][u] = 0x1FF;
+    for (int d = 0; d < N; d++) {
+        for (int u = 0; u < N; u++) {
+            st->row_mask[d][u] = ALL_DIGITS;
+            st->col_mask[d][u] = ALL_DIGITS;
+            st->box_mask[d][u] = ALL_DIGITS;
         }
     }
     
-    for (int i = 0; i < 81; i++) {
-        if (s[i] >= '1' && s[i] <= '9')
-            place(i, s[i] - '1');
+    for (int i = 0; i < CELLS && st->unsolved > 0; i++) {
+        int v = symbol_value(s[i]);
+        if (!v || st->grid[i] == v) continue;
+        if (!(st->cands[i] & (1 << (v - 1)))) st->unsolved = -1;
+        else place(st, i, v - 1);
     }
 }
 
-static int hidden_single(void) {
-    for (int d = 0; d < 9; d++) {
-        for (int r = 0; r < 9; r++) {
-            u16 m = row_mask[d][r];
+// Each technique takes, laid out like st->changed, the units whose masks
+// changed since it last scanned them and found nothing; see grade().
+// Techniques that look at whole cells use the union over digits.
+static inline mask_t dirty_units(mask_t (*dirty)[N], int t) {
+    mask_t m = 0;
+    for (int d = 0; d < N; d++) m |= dirty[t][d];
+    return m;
+}
+
+static inline void unit_clean(mask_t (*dirty)[N], int t, int u) {
+    for (int d = 0; d < N; d++) dirty[t][d] &= ~(1u << u);
+}
+
+static inline void clean_digits(mask_t (*dirty)[N], int n) {
+    for (int t = 0; t < 3; t++)
+        for (int d = 0; d < n; d++) dirty[t][d] = 0;
+}
+
+// A find leaves the digits before it clean.
+static int hidden_single(SolverState *st, mask_t (*dirty)[N]) {
+    for (int d = 0; d < N; d++) {
+        for (mask_t u = dirty[UNIT_ROW][d]; u; u &= u - 1) {
+            int r = __builtin_ctz(u);
+            mask_t m = st->row_mask[d][r];
             if (m && !(m & (m-1))) {
-                place(r * 9 + __builtin_ctz(m), d);
+                place_tracked(st, r * N + __builtin_ctz(m), d);
+                clean_digits(dirty, d);
                 return 1;
             }
         }
-        for (int c = 0; c < 9; c++) {
-            u16 m = col_mask[d][c];
+        for (mask_t u = dirty[UNIT_COL][d]; u; u &= u - 1) {
+            int c = __builtin_ctz(u);
+            mask_t m = st->col_mask[d][c];
             if (m && !(m & (m-1))) {
-                place(__builtin_ctz(m) * 9 + c, d);
+                place_tracked(st, __builtin_ctz(m) * N + c, d);
+                clean_digits(dirty, d);
                 return 1;
             }
         }
-        for (int b = 0; b < 9; b++) {
-            u16 m = box_mask[d][b];
+        for (mask_t u = dirty[UNIT_BOX][d]; u; u &= u - 1) {
+            int b = __builtin_ctz(u);
+            mask_t m = st->box_mask[d][b];
             if (m && !(m & (m-1))) {
-                place(box_cell[b][__builtin_ctz(m)], d);
+                place_tracked(st, box_cell[b][__builtin_ctz(m)], d);
+                clean_digits(dirty, d);
                 return 1;
             }
         }
     }
+    clean_digits(dirty, N);
     return 0;
 }
 
-static int pointing(void) {
+static inline int place_unit_single(SolverState *st, int k) {
+    mask_t m = st->unit_mask[k];
+    if (!m || (m & (m-1))) return 0;
+    int t = k / CELLS, d = k % CELLS / N, u = k % N, pos = __builtin_ctz(m);
+    place(st, t == 0 ? u * N + pos : t == 1 ? pos * N + u : box_cell[u][pos], d);
+    return 1;
+}
+
+// Places every hidden single visible in one sweep over the 3*CELLS digit/unit masks.
+static int hidden_singles_scalar(SolverState *st) {
+    int found = 0;
+    STAT_INC(sweeps);
+    for (int k = 0; k < 3*CELLS && st->unsolved > 0; k++)
+        found |= place_unit_single(st, k);
+    return found;
+}
+
+// One 16-lane vector covers a digit's units up to 16x16.
+#if defined(SIMD_UNITS) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+
+// Puzzles solved side by side in singles mode; the counters of a STATS build
+// are per puzzle, so it keeps the scalar path.
+#ifndef STATS
+#define LANES 16
+#endif
+
+__attribute__((target("avx2")))
+static void clear_digit_avx2(SolverState *st, int i, int d) {
+    for (int t = 0; t < 3; t++) {
+        u16 *p = &st->unit_mask[t * CELLS + d * N];
+        __m256i old = _mm256_loadu_si256((const __m256i *)p);
+        __m256i v = _mm256_and_si256(old, _mm256_load_si256((const __m256i *)digit_keep[i][t]));
+        if (st->trail) {
+            u32 changed = ~_mm256_movemask_epi8(_mm256_cmpeq_epi16(old, v)) & 0x55555555;
+            for (; changed; changed &= changed - 1) {
+                int u = __builtin_ctz(changed) / 2;
+                trail_push(st, &p[u], p[u]);
+            }
+        }
+        _mm256_storeu_si256((__m256i *)p, v);
+    }
+}
+
+__attribute__((target("avx2")))
+static int hidden_singles_avx2(SolverState *st) {
+    const __m256i one = _mm256_set1_epi16(1), zero = _mm256_setzero_si256();
+    int found = 0;
+    STAT_INC(sweeps);
+    for (int k = 0; k < UNIT_MASKS; k += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&st->unit_mask[k]);
+        __m256i pow2 = _mm256_cmpeq_epi16(_mm256_and_si256(v, _mm256_sub_epi16(v, one)), zero);
+        __m256i single = _mm256_andnot_si256(_mm256_cmpeq_epi16(v, zero), pow2);
+        u32 bits = _mm256_movemask_epi8(single) & 0x55555555;
+        for (; bits; bits &= bits - 1) {
+            found |= place_unit_single(st, k + __builtin_ctz(bits) / 2);
+            if (st->unsolved <= 0) return 1;
+        }
+    }
+    return found;
+}
+
+static void init_simd(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        clear_digit = clear_digit_avx2;
+        hidden_singles = hidden_singles_avx2;
+#ifdef LANES
+        lanes_on = 1;
+#endif
+    }
+}
+#else
+static void init_simd(void) {}
+#endif
+
+// Index of the box line in segs that holds every bit of m, or -1.
+static inline int box_line_of(mask_t m, const mask_t *segs) {
+    for (int k = 0; k < BOX; k++)
+        if ((m & segs[k]) == m) return k;
+    return -1;
+}
+
+// Full passes over every digit: a unit changed earlier in the pass counts as
+// dirty when it is checked, and changes after the check stay in st->changed
+// for the next step, so all are clean at the end.
+static int pointing(SolverState *st, mask_t (*dirty)[N]) {
     int changed = 0;
     
-    for (int d = 0; d < 9; d++) {
-        int naked[27], nc = 0;
+    for (int d = 0; d < N; d++) {
+        int naked[3*N], nc = 0;
         
-        for (int b = 0; b < 9; b++) {
-            u16 m = box_mask[d][b];
+        for (int b = 0; b < N; b++) {
+            if (!((dirty[UNIT_BOX][d] | st->changed[UNIT_BOX][d]) >> b & 1)) continue;
+            mask_t m = st->box_mask[d][b];
             if (!m) continue;
             
-            int br = (b / 3) * 3;
-            int bc = (b % 3) * 3;
+            int br = (b / BOX) * BOX;
+            int bc = (b % BOX) * BOX;
             
-            if ((m & 0x007) == m || (m & 0x038) == m || (m & 0x1C0) == m) {
-                int lr = (m & 0x007) ? 0 : (m & 0x038) ? 1 : 2;
+            int lr = box_line_of(m, box_seg);
+            if (lr >= 0) {
                 int r = br + lr;
-                for (int c = 0; c < 9; c++) {
-                    if (c / 3 == b % 3) continue;
-                    int cell = r * 9 + c;
-                    if (!(cands[cell] & (1 << d))) continue;
-                    int ns = eliminate(cell, d);
-                    if (ns == -2) { unsolved = -1; return 1; }
+                for (int c = 0; c < N; c++) {
+                    if (c / BOX == b % BOX) continue;
+                    int cell = r * N + c;
+                    if (!(st->cands[cell] & (1 << d))) continue;
+                    int ns = eliminate(st, cell, d);
+                    if (ns == -2) { st->unsolved = -1; return 1; }
                     if (ns >= 0) naked[nc++] = ns;
                     changed = 1;
                 }
             }
             
-            if ((m & 0x049) == m || (m & 0x092) == m || (m & 0x124) == m) {
-                int lc = (m & 0x049) ? 0 : (m & 0x092) ? 1 : 2;
+            int lc = box_line_of(m, box_stride);
+            if (lc >= 0) {
                 int c = bc + lc;
-                for (int r = 0; r < 9; r++) {
-                    if (r / 3 == b / 3) continue;
-                    int cell = r * 9 + c;
-                    if (!(cands[cell] & (1 << d))) continue;
-                    int ns = eliminate(cell, d);
-                    if (ns == -2) { unsolved = -1; return 1; }
+                for (int r = 0; r < N; r++) {
+                    if (r / BOX == b / BOX) continue;
+                    int cell = r * N + c;
+                    if (!(st->cands[cell] & (1 << d))) continue;
+                    int ns = eliminate(st, cell, d);
+                    if (ns == -2) { st->unsolved = -1; return 1; }
                     if (ns >= 0) naked[nc++] = ns;
                     changed = 1;
                 }
@@ -183,35 +513,38 @@ static int pointing(void) {
         }
         
         for (int n = 0; n < nc; n++) {
-            if (!cands[naked[n]]) continue;
-            place(naked[n], __builtin_ctz(cands[naked[n]]));
-            if (unsolved <= 0) return 1;
+            if (!st->cands[naked[n]]) continue;
+            place_tracked(st, naked[n], __builtin_ctz(st->cands[naked[n]]));
+            if (st->unsolved <= 0) return 1;
         }
     }
     
+    memset(dirty[UNIT_BOX], 0, sizeof(dirty[UNIT_BOX]));
     return changed;
 }
 
-static int box_line(void) {
+static int box_line(SolverState *st, mask_t (*dirty)[N]) {
     int changed = 0;
     
-    for (int d = 0; d < 9; d++) {
-        int naked[18], nc = 0;
+    for (int d = 0; d < N; d++) {
+        int naked[2*N], nc = 0;
         
-        for (int r = 0; r < 9; r++) {
-            u16 m = row_mask[d][r];
+        for (int r = 0; r < N; r++) {
+            if (!((dirty[UNIT_ROW][d] | st->changed[UNIT_ROW][d]) >> r & 1)) continue;
+            mask_t m = st->row_mask[d][r];
             if (!m) continue;
             
-            if ((m & 0x007) == m || (m & 0x038) == m || (m & 0x1C0) == m) {
-                int bc = (m & 0x007) ? 0 : (m & 0x038) ? 3 : 6;
-                int br = (r / 3) * 3;
-                for (int rr = br; rr < br + 3; rr++) {
+            int k = box_line_of(m, box_seg);
+            if (k >= 0) {
+                int bc = k * BOX;
+                int br = (r / BOX) * BOX;
+                for (int rr = br; rr < br + BOX; rr++) {
                     if (rr == r) continue;
-                    for (int cc = bc; cc < bc + 3; cc++) {
-                        int cell = rr * 9 + cc;
-                        if (!(cands[cell] & (1 << d))) continue;
-                        int ns = eliminate(cell, d);
-                        if (ns == -2) { unsolved = -1; return 1; }
+                    for (int cc = bc; cc < bc + BOX; cc++) {
+                        int cell = rr * N + cc;
+                        if (!(st->cands[cell] & (1 << d))) continue;
+                        int ns = eliminate(st, cell, d);
+                        if (ns == -2) { st->unsolved = -1; return 1; }
                         if (ns >= 0) naked[nc++] = ns;
                         changed = 1;
                     }
@@ -219,20 +552,22 @@ static int box_line(void) {
             }
         }
         
-        for (int c = 0; c < 9; c++) {
-            u16 m = col_mask[d][c];
+        for (int c = 0; c < N; c++) {
+            if (!((dirty[UNIT_COL][d] | st->changed[UNIT_COL][d]) >> c & 1)) continue;
+            mask_t m = st->col_mask[d][c];
             if (!m) continue;
             
-            if ((m & 0x007) == m || (m & 0x038) == m || (m & 0x1C0) == m) {
-                int br = (m & 0x007) ? 0 : (m & 0x038) ? 3 : 6;
-                int bc = (c / 3) * 3;
-                for (int rr = br; rr < br + 3; rr++) {
-                    for (int cc = bc; cc < bc + 3; cc++) {
+            int k = box_line_of(m, box_seg);
+            if (k >= 0) {
+                int br = k * BOX;
+                int bc = (c / BOX) * BOX;
+                for (int rr = br; rr < br + BOX; rr++) {
+                    for (int cc = bc; cc < bc + BOX; cc++) {
                         if (cc == c) continue;
-                        int cell = rr * 9 + cc;
-                        if (!(cands[cell] & (1 << d))) continue;
-                        int ns = eliminate(cell, d);
-                        if (ns == -2) { unsolved = -1; return 1; }
+                        int cell = rr * N + cc;
+                        if (!(st->cands[cell] & (1 << d))) continue;
+                        int ns = eliminate(st, cell, d);
+                        if (ns == -2) { st->unsolved = -1; return 1; }
                         if (ns >= 0) naked[nc++] = ns;
                         changed = 1;
                     }
@@ -241,37 +576,42 @@ static int box_line(void) {
         }
         
         for (int n = 0; n < nc; n++) {
-            if (!cands[naked[n]]) continue;
-            place(naked[n], __builtin_ctz(cands[naked[n]]));
-            if (unsolved <= 0) return 1;
+            if (!st->cands[naked[n]]) continue;
+            place_tracked(st, naked[n], __builtin_ctz(st->cands[naked[n]]));
+            if (st->unsolved <= 0) return 1;
         }
     }
     
+    memset(dirty[UNIT_ROW], 0, sizeof(dirty[UNIT_ROW]));
+    memset(dirty[UNIT_COL], 0, sizeof(dirty[UNIT_COL]));
     return changed;
 }
 
-static int naked_pairs(void) {
-    for (int r = 0; r < 9; r++) {
-        int base = r * 9;
-        for (int c1 = 0; c1 < 8; c1++) {
+static int naked_pairs(SolverState *st, mask_t (*dirty)[N]) {
+    mask_t rows = dirty_units(dirty, UNIT_ROW), cols = dirty_units(dirty, UNIT_COL), boxes = dirty_units(dirty, UNIT_BOX);
+    for (int r = 0; r < N; r++) {
+        if (!(rows >> r & 1)) continue;
+        unit_clean(dirty, UNIT_ROW, r);
+        int base = r * N;
+        for (int c1 = 0; c1 < N - 1; c1++) {
             int cell1 = base + c1;
-            u16 m1 = cands[cell1];
+            mask_t m1 = st->cands[cell1];
             if (__builtin_popcount(m1) != 2) continue;
-            for (int c2 = c1 + 1; c2 < 9; c2++) {
-                if (cands[base + c2] != m1) continue;
-                for (int c = 0; c < 9; c++) {
+            for (int c2 = c1 + 1; c2 < N; c2++) {
+                if (st->cands[base + c2] != m1) continue;
+                for (int c = 0; c < N; c++) {
                     if (c == c1 || c == c2) continue;
                     int cell = base + c;
-                    u16 elim = cands[cell] & m1;
+                    mask_t elim = st->cands[cell] & m1;
                     if (!elim) continue;
                     while (elim) {
                         int dd = __builtin_ctz(elim);
                         elim &= elim - 1;
-                        int ns = eliminate(cell, dd);
-                        if (ns == -2) { unsolved = -1; return 1; }
+                        int ns = eliminate(st, cell, dd);
+                        if (ns == -2) { st->unsolved = -1; return 1; }
                         if (ns >= 0) {
-                            place(ns, __builtin_ctz(cands[ns]));
-                            if (unsolved <= 0) return 1;
+                            place_tracked(st, ns, __builtin_ctz(st->cands[ns]));
+                            if (st->unsolved <= 0) return 1;
                         }
                     }
                     return 1;
@@ -280,26 +620,28 @@ static int naked_pairs(void) {
         }
     }
     
-    for (int c = 0; c < 9; c++) {
-        for (int r1 = 0; r1 < 8; r1++) {
-            int cell1 = r1 * 9 + c;
-            u16 m1 = cands[cell1];
+    for (int c = 0; c < N; c++) {
+        if (!(cols >> c & 1)) continue;
+        unit_clean(dirty, UNIT_COL, c);
+        for (int r1 = 0; r1 < N - 1; r1++) {
+            int cell1 = r1 * N + c;
+            mask_t m1 = st->cands[cell1];
             if (__builtin_popcount(m1) != 2) continue;
-            for (int r2 = r1 + 1; r2 < 9; r2++) {
-                if (cands[r2 * 9 + c] != m1) continue;
-                for (int r = 0; r < 9; r++) {
+            for (int r2 = r1 + 1; r2 < N; r2++) {
+                if (st->cands[r2 * N + c] != m1) continue;
+                for (int r = 0; r < N; r++) {
                     if (r == r1 || r == r2) continue;
-                    int cell = r * 9 + c;
-                    u16 elim = cands[cell] & m1;
+                    int cell = r * N + c;
+                    mask_t elim = st->cands[cell] & m1;
                     if (!elim) continue;
                     while (elim) {
                         int dd = __builtin_ctz(elim);
                         elim &= elim - 1;
-                        int ns = eliminate(cell, dd);
-                        if (ns == -2) { unsolved = -1; return 1; }
+                        int ns = eliminate(st, cell, dd);
+                        if (ns == -2) { st->unsolved = -1; return 1; }
                         if (ns >= 0) {
-                            place(ns, __builtin_ctz(cands[ns]));
-                            if (unsolved <= 0) return 1;
+                            place_tracked(st, ns, __builtin_ctz(st->cands[ns]));
+                            if (st->unsolved <= 0) return 1;
                         }
                     }
                     return 1;
@@ -308,26 +650,28 @@ static int naked_pairs(void) {
         }
     }
     
-    for (int b = 0; b < 9; b++) {
-        for (int bp1 = 0; bp1 < 8; bp1++) {
+    for (int b = 0; b < N; b++) {
+        if (!(boxes >> b & 1)) continue;
+        unit_clean(dirty, UNIT_BOX, b);
+        for (int bp1 = 0; bp1 < N - 1; bp1++) {
             int cell1 = box_cell[b][bp1];
-            u16 m1 = cands[cell1];
+            mask_t m1 = st->cands[cell1];
             if (__builtin_popcount(m1) != 2) continue;
-            for (int bp2 = bp1 + 1; bp2 < 9; bp2++) {
-                if (cands[box_cell[b][bp2]] != m1) continue;
-                for (int bp = 0; bp < 9; bp++) {
+            for (int bp2 = bp1 + 1; bp2 < N; bp2++) {
+                if (st->cands[box_cell[b][bp2]] != m1) continue;
+                for (int bp = 0; bp < N; bp++) {
                     if (bp == bp1 || bp == bp2) continue;
                     int cell = box_cell[b][bp];
-                    u16 elim = cands[cell] & m1;
+                    mask_t elim = st->cands[cell] & m1;
                     if (!elim) continue;
                     while (elim) {
                         int dd = __builtin_ctz(elim);
                         elim &= elim - 1;
-                        int ns = eliminate(cell, dd);
-                        if (ns == -2) { unsolved = -1; return 1; }
+                        int ns = eliminate(st, cell, dd);
+                        if (ns == -2) { st->unsolved = -1; return 1; }
                         if (ns >= 0) {
-                            place(ns, __builtin_ctz(cands[ns]));
-                            if (unsolved <= 0) return 1;
+                            place_tracked(st, ns, __builtin_ctz(st->cands[ns]));
+                            if (st->unsolved <= 0) return 1;
                         }
                     }
                     return 1;
@@ -339,30 +683,33 @@ static int naked_pairs(void) {
     return 0;
 }
 
-static int hidden_pairs(void) {
-    for (int r = 0; r < 9; r++) {
-        int valid[9], nv = 0;
-        for (int d = 0; d < 9; d++)
-            if (__builtin_popcount(row_mask[d][r]) == 2)
+static int hidden_pairs(SolverState *st, mask_t (*dirty)[N]) {
+    mask_t rows = dirty_units(dirty, UNIT_ROW), cols = dirty_units(dirty, UNIT_COL), boxes = dirty_units(dirty, UNIT_BOX);
+    for (int r = 0; r < N; r++) {
+        if (!(rows >> r & 1)) continue;
+        unit_clean(dirty, UNIT_ROW, r);
+        int valid[N], nv = 0;
+        for (int d = 0; d < N; d++)
+            if (__builtin_popcount(st->row_mask[d][r]) == 2)
                 valid[nv++] = d;
         for (int i = 0; i < nv; i++) {
-            u16 m1 = row_mask[valid[i]][r];
+            mask_t m1 = st->row_mask[valid[i]][r];
             for (int j = i + 1; j < nv; j++) {
-                if (row_mask[valid[j]][r] != m1) continue;
-                u16 pair = (1 << valid[i]) | (1 << valid[j]);
+                if (st->row_mask[valid[j]][r] != m1) continue;
+                mask_t pair = (1 << valid[i]) | (1 << valid[j]);
                 int found = 0;
-                u16 m = m1;
+                mask_t m = m1;
                 while (m) {
                     int c = __builtin_ctz(m);
                     m &= m - 1;
-                    int cell = r * 9 + c;
-                    u16 elim = cands[cell] & ~pair;
+                    int cell = r * N + c;
+                    mask_t elim = st->cands[cell] & ~pair;
                     if (!elim) continue;
                     found = 1;
                     while (elim) {
                         int dd = __builtin_ctz(elim);
                         elim &= elim - 1;
-                        if (eliminate(cell, dd) == -2) { unsolved = -1; return 1; }
+                        if (eliminate(st, cell, dd) == -2) { st->unsolved = -1; return 1; }
                     }
                 }
                 if (found) return 1;
@@ -370,29 +717,31 @@ static int hidden_pairs(void) {
         }
     }
     
-    for (int c = 0; c < 9; c++) {
-        int valid[9], nv = 0;
-        for (int d = 0; d < 9; d++)
-            if (__builtin_popcount(col_mask[d][c]) == 2)
+    for (int c = 0; c < N; c++) {
+        if (!(cols >> c & 1)) continue;
+        unit_clean(dirty, UNIT_COL, c);
+        int valid[N], nv = 0;
+        for (int d = 0; d < N; d++)
+            if (__builtin_popcount(st->col_mask[d][c]) == 2)
                 valid[nv++] = d;
         for (int i = 0; i < nv; i++) {
-            u16 m1 = col_mask[valid[i]][c];
+            mask_t m1 = st->col_mask[valid[i]][c];
             for (int j = i + 1; j < nv; j++) {
-                if (col_mask[valid[j]][c] != m1) continue;
-                u16 pair = (1 << valid[i]) | (1 << valid[j]);
+                if (st->col_mask[valid[j]][c] != m1) continue;
+                mask_t pair = (1 << valid[i]) | (1 << valid[j]);
                 int found = 0;
-                u16 m = m1;
+                mask_t m = m1;
                 while (m) {
                     int r = __builtin_ctz(m);
                     m &= m - 1;
-                    int cell = r * 9 + c;
-                    u16 elim = cands[cell] & ~pair;
+                    int cell = r * N + c;
+                    mask_t elim = st->cands[cell] & ~pair;
                     if (!elim) continue;
                     found = 1;
                     while (elim) {
                         int dd = __builtin_ctz(elim);
                         elim &= elim - 1;
-                        if (eliminate(cell, dd) == -2) { unsolved = -1; return 1; }
+                        if (eliminate(st, cell, dd) == -2) { st->unsolved = -1; return 1; }
                     }
                 }
                 if (found) return 1;
@@ -400,29 +749,31 @@ static int hidden_pairs(void) {
         }
     }
     
-    for (int b = 0; b < 9; b++) {
-        int valid[9], nv = 0;
-        for (int d = 0; d < 9; d++)
-            if (__builtin_popcount(box_mask[d][b]) == 2)
+    for (int b = 0; b < N; b++) {
+        if (!(boxes >> b & 1)) continue;
+        unit_clean(dirty, UNIT_BOX, b);
+        int valid[N], nv = 0;
+        for (int d = 0; d < N; d++)
+            if (__builtin_popcount(st->box_mask[d][b]) == 2)
                 valid[nv++] = d;
         for (int i = 0; i < nv; i++) {
-            u16 m1 = box_mask[valid[i]][b];
+            mask_t m1 = st->box_mask[valid[i]][b];
             for (int j = i + 1; j < nv; j++) {
-                if (box_mask[valid[j]][b] != m1) continue;
-                u16 pair = (1 << valid[i]) | (1 << valid[j]);
+                if (st->box_mask[valid[j]][b] != m1) continue;
+                mask_t pair = (1 << valid[i]) | (1 << valid[j]);
                 int found = 0;
-                u16 m = m1;
+                mask_t m = m1;
                 while (m) {
                     int bp = __builtin_ctz(m);
                     m &= m - 1;
                     int cell = box_cell[b][bp];
-                    u16 elim = cands[cell] & ~pair;
+                    mask_t elim = st->cands[cell] & ~pair;
                     if (!elim) continue;
                     found = 1;
                     while (elim) {
                         int dd = __builtin_ctz(elim);
                         elim &= elim - 1;
-                        if (eliminate(cell, dd) == -2) { unsolved = -1; return 1; }
+                        if (eliminate(st, cell, dd) == -2) { st->unsolved = -1; return 1; }
                     }
                 }
                 if (found) return 1;
@@ -433,38 +784,41 @@ static int hidden_pairs(void) {
     return 0;
 }
 
-static int naked_triples(void) {
-    for (int r = 0; r < 9; r++) {
-        int base = r * 9;
-        for (int c1 = 0; c1 < 7; c1++) {
-            u16 m1 = cands[base + c1];
+static int naked_triples(SolverState *st, mask_t (*dirty)[N]) {
+    mask_t rows = dirty_units(dirty, UNIT_ROW), cols = dirty_units(dirty, UNIT_COL), boxes = dirty_units(dirty, UNIT_BOX);
+    for (int r = 0; r < N; r++) {
+        if (!(rows >> r & 1)) continue;
+        unit_clean(dirty, UNIT_ROW, r);
+        int base = r * N;
+        for (int c1 = 0; c1 < N - 2; c1++) {
+            mask_t m1 = st->cands[base + c1];
             int pc1 = __builtin_popcount(m1);
             if (pc1 < 2 || pc1 > 3) continue;
-            for (int c2 = c1 + 1; c2 < 8; c2++) {
-                u16 m2 = cands[base + c2];
+            for (int c2 = c1 + 1; c2 < N - 1; c2++) {
+                mask_t m2 = st->cands[base + c2];
                 int pc2 = __builtin_popcount(m2);
                 if (pc2 < 2 || pc2 > 3) continue;
-                u16 u12 = m1 | m2;
+                mask_t u12 = m1 | m2;
                 if (__builtin_popcount(u12) > 3) continue;
-                for (int c3 = c2 + 1; c3 < 9; c3++) {
-                    u16 m3 = cands[base + c3];
+                for (int c3 = c2 + 1; c3 < N; c3++) {
+                    mask_t m3 = st->cands[base + c3];
                     int pc3 = __builtin_popcount(m3);
                     if (pc3 < 2 || pc3 > 3) continue;
-                    u16 triple = u12 | m3;
+                    mask_t triple = u12 | m3;
                     if (__builtin_popcount(triple) != 3) continue;
-                    for (int c = 0; c < 9; c++) {
+                    for (int c = 0; c < N; c++) {
                         if (c == c1 || c == c2 || c == c3) continue;
                         int cell = base + c;
-                        u16 elim = cands[cell] & triple;
+                        mask_t elim = st->cands[cell] & triple;
                         if (!elim) continue;
                         while (elim) {
                             int dd = __builtin_ctz(elim);
                             elim &= elim - 1;
-                            int ns = eliminate(cell, dd);
-                            if (ns == -2) { unsolved = -1; return 1; }
+                            int ns = eliminate(st, cell, dd);
+                            if (ns == -2) { st->unsolved = -1; return 1; }
                             if (ns >= 0) {
-                                place(ns, __builtin_ctz(cands[ns]));
-                                if (unsolved <= 0) return 1;
+                                place_tracked(st, ns, __builtin_ctz(st->cands[ns]));
+                                if (st->unsolved <= 0) return 1;
                             }
                         }
                         return 1;
@@ -474,36 +828,38 @@ static int naked_triples(void) {
         }
     }
     
-    for (int c = 0; c < 9; c++) {
-        for (int r1 = 0; r1 < 7; r1++) {
-            u16 m1 = cands[r1 * 9 + c];
+    for (int c = 0; c < N; c++) {
+        if (!(cols >> c & 1)) continue;
+        unit_clean(dirty, UNIT_COL, c);
+        for (int r1 = 0; r1 < N - 2; r1++) {
+            mask_t m1 = st->cands[r1 * N + c];
             int pc1 = __builtin_popcount(m1);
             if (pc1 < 2 || pc1 > 3) continue;
-            for (int r2 = r1 + 1; r2 < 8; r2++) {
-                u16 m2 = cands[r2 * 9 + c];
+            for (int r2 = r1 + 1; r2 < N - 1; r2++) {
+                mask_t m2 = st->cands[r2 * N + c];
                 int pc2 = __builtin_popcount(m2);
                 if (pc2 < 2 || pc2 > 3) continue;
-                u16 u12 = m1 | m2;
+                mask_t u12 = m1 | m2;
                 if (__builtin_popcount(u12) > 3) continue;
-                for (int r3 = r2 + 1; r3 < 9; r3++) {
-                    u16 m3 = cands[r3 * 9 + c];
+                for (int r3 = r2 + 1; r3 < N; r3++) {
+                    mask_t m3 = st->cands[r3 * N + c];
                     int pc3 = __builtin_popcount(m3);
                     if (pc3 < 2 || pc3 > 3) continue;
-                    u16 triple = u12 | m3;
+                    mask_t triple = u12 | m3;
                     if (__builtin_popcount(triple) != 3) continue;
-                    for (int r = 0; r < 9; r++) {
+                    for (int r = 0; r < N; r++) {
                         if (r == r1 || r == r2 || r == r3) continue;
-                        int cell = r * 9 + c;
-                        u16 elim = cands[cell] & triple;
+                        int cell = r * N + c;
+                        mask_t elim = st->cands[cell] & triple;
                         if (!elim) continue;
                         while (elim) {
                             int dd = __builtin_ctz(elim);
                             elim &= elim - 1;
-                            int ns = eliminate(cell, dd);
-                            if (ns == -2) { unsolved = -1; return 1; }
+                            int ns = eliminate(st, cell, dd);
+                            if (ns == -2) { st->unsolved = -1; return 1; }
                             if (ns >= 0) {
-                                place(ns, __builtin_ctz(cands[ns]));
-                                if (unsolved <= 0) return 1;
+                                place_tracked(st, ns, __builtin_ctz(st->cands[ns]));
+                                if (st->unsolved <= 0) return 1;
                             }
                         }
                         return 1;
@@ -513,36 +869,38 @@ static int naked_triples(void) {
         }
     }
     
-    for (int b = 0; b < 9; b++) {
-        for (int bp1 = 0; bp1 < 7; bp1++) {
-            u16 m1 = cands[box_cell[b][bp1]];
+    for (int b = 0; b < N; b++) {
+        if (!(boxes >> b & 1)) continue;
+        unit_clean(dirty, UNIT_BOX, b);
+        for (int bp1 = 0; bp1 < N - 2; bp1++) {
+            mask_t m1 = st->cands[box_cell[b][bp1]];
             int pc1 = __builtin_popcount(m1);
             if (pc1 < 2 || pc1 > 3) continue;
-            for (int bp2 = bp1 + 1; bp2 < 8; bp2++) {
-                u16 m2 = cands[box_cell[b][bp2]];
+            for (int bp2 = bp1 + 1; bp2 < N - 1; bp2++) {
+                mask_t m2 = st->cands[box_cell[b][bp2]];
                 int pc2 = __builtin_popcount(m2);
                 if (pc2 < 2 || pc2 > 3) continue;
-                u16 u12 = m1 | m2;
+                mask_t u12 = m1 | m2;
                 if (__builtin_popcount(u12) > 3) continue;
-                for (int bp3 = bp2 + 1; bp3 < 9; bp3++) {
-                    u16 m3 = cands[box_cell[b][bp3]];
+                for (int bp3 = bp2 + 1; bp3 < N; bp3++) {
+                    mask_t m3 = st->cands[box_cell[b][bp3]];
                     int pc3 = __builtin_popcount(m3);
                     if (pc3 < 2 || pc3 > 3) continue;
-                    u16 triple = u12 | m3;
+                    mask_t triple = u12 | m3;
                     if (__builtin_popcount(triple) != 3) continue;
-                    for (int bp = 0; bp < 9; bp++) {
+                    for (int bp = 0; bp < N; bp++) {
                         if (bp == bp1 || bp == bp2 || bp == bp3) continue;
                         int cell = box_cell[b][bp];
-                        u16 elim = cands[cell] & triple;
+                        mask_t elim = st->cands[cell] & triple;
                         if (!elim) continue;
                         while (elim) {
                             int dd = __builtin_ctz(elim);
                             elim &= elim - 1;
-                            int ns = eliminate(cell, dd);
-                            if (ns == -2) { unsolved = -1; return 1; }
+                            int ns = eliminate(st, cell, dd);
+                            if (ns == -2) { st->unsolved = -1; return 1; }
                             if (ns >= 0) {
-                                place(ns, __builtin_ctz(cands[ns]));
-                                if (unsolved <= 0) return 1;
+                                place_tracked(st, ns, __builtin_ctz(st->cands[ns]));
+                                if (st->unsolved <= 0) return 1;
                             }
                         }
                         return 1;
@@ -555,43 +913,46 @@ static int naked_triples(void) {
     return 0;
 }
 
-static int hidden_triples(void) {
-    for (int r = 0; r < 9; r++) {
-        int valid[9], nv = 0;
-        for (int d = 0; d < 9; d++) {
-            int pc = __builtin_popcount(row_mask[d][r]);
+static int hidden_triples(SolverState *st, mask_t (*dirty)[N]) {
+    mask_t rows = dirty_units(dirty, UNIT_ROW), cols = dirty_units(dirty, UNIT_COL), boxes = dirty_units(dirty, UNIT_BOX);
+    for (int r = 0; r < N; r++) {
+        if (!(rows >> r & 1)) continue;
+        unit_clean(dirty, UNIT_ROW, r);
+        int valid[N], nv = 0;
+        for (int d = 0; d < N; d++) {
+            int pc = __builtin_popcount(st->row_mask[d][r]);
             if (pc >= 2 && pc <= 3)
                 valid[nv++] = d;
         }
         if (nv < 3) continue;
         for (int i = 0; i < nv - 2; i++) {
-            u16 m1 = row_mask[valid[i]][r];
+            mask_t m1 = st->row_mask[valid[i]][r];
             for (int j = i + 1; j < nv - 1; j++) {
-                u16 m2 = row_mask[valid[j]][r];
-                u16 u12 = m1 | m2;
+                mask_t m2 = st->row_mask[valid[j]][r];
+                mask_t u12 = m1 | m2;
                 if (__builtin_popcount(u12) > 3) continue;
                 for (int k = j + 1; k < nv; k++) {
-                    u16 m3 = row_mask[valid[k]][r];
-                    u16 cells = u12 | m3;
+                    mask_t m3 = st->row_mask[valid[k]][r];
+                    mask_t cells = u12 | m3;
                     if (__builtin_popcount(cells) != 3) continue;
-                    u16 triple = (1 << valid[i]) | (1 << valid[j]) | (1 << valid[k]);
+                    mask_t triple = (1 << valid[i]) | (1 << valid[j]) | (1 << valid[k]);
                     int found = 0;
-                    u16 m = cells;
+                    mask_t m = cells;
                     while (m) {
                         int c = __builtin_ctz(m);
                         m &= m - 1;
-                        int cell = r * 9 + c;
-                        u16 elim = cands[cell] & ~triple;
+                        int cell = r * N + c;
+                        mask_t elim = st->cands[cell] & ~triple;
                         if (!elim) continue;
                         found = 1;
                         while (elim) {
                             int dd = __builtin_ctz(elim);
                             elim &= elim - 1;
-                            int ns = eliminate(cell, dd);
-                            if (ns == -2) { unsolved = -1; return 1; }
+                            int ns = eliminate(st, cell, dd);
+                            if (ns == -2) { st->unsolved = -1; return 1; }
                             if (ns >= 0) {
-                                place(ns, __builtin_ctz(cands[ns]));
-                                if (unsolved <= 0) return 1;
+                                place_tracked(st, ns, __builtin_ctz(st->cands[ns]));
+                                if (st->unsolved <= 0) return 1;
                             }
                         }
                     }
@@ -601,42 +962,44 @@ static int hidden_triples(void) {
         }
     }
     
-    for (int c = 0; c < 9; c++) {
-        int valid[9], nv = 0;
-        for (int d = 0; d < 9; d++) {
-            int pc = __builtin_popcount(col_mask[d][c]);
+    for (int c = 0; c < N; c++) {
+        if (!(cols >> c & 1)) continue;
+        unit_clean(dirty, UNIT_COL, c);
+        int valid[N], nv = 0;
+        for (int d = 0; d < N; d++) {
+            int pc = __builtin_popcount(st->col_mask[d][c]);
             if (pc >= 2 && pc <= 3)
                 valid[nv++] = d;
         }
         if (nv < 3) continue;
         for (int i = 0; i < nv - 2; i++) {
-            u16 m1 = col_mask[valid[i]][c];
+            mask_t m1 = st->col_mask[valid[i]][c];
             for (int j = i + 1; j < nv - 1; j++) {
-                u16 m2 = col_mask[valid[j]][c];
-                u16 u12 = m1 | m2;
+                mask_t m2 = st->col_mask[valid[j]][c];
+                mask_t u12 = m1 | m2;
                 if (__builtin_popcount(u12) > 3) continue;
                 for (int k = j + 1; k < nv; k++) {
-                    u16 m3 = col_mask[valid[k]][c];
-                    u16 cells = u12 | m3;
+                    mask_t m3 = st->col_mask[valid[k]][c];
+                    mask_t cells = u12 | m3;
                     if (__builtin_popcount(cells) != 3) continue;
-                    u16 triple = (1 << valid[i]) | (1 << valid[j]) | (1 << valid[k]);
+                    mask_t triple = (1 << valid[i]) | (1 << valid[j]) | (1 << valid[k]);
                     int found = 0;
-                    u16 m = cells;
+                    mask_t m = cells;
                     while (m) {
                         int r = __builtin_ctz(m);
                         m &= m - 1;
-                        int cell = r * 9 + c;
-                        u16 elim = cands[cell] & ~triple;
+                        int cell = r * N + c;
+                        mask_t elim = st->cands[cell] & ~triple;
                         if (!elim) continue;
                         found = 1;
                         while (elim) {
                             int dd = __builtin_ctz(elim);
                             elim &= elim - 1;
-                            int ns = eliminate(cell, dd);
-                            if (ns == -2) { unsolved = -1; return 1; }
+                            int ns = eliminate(st, cell, dd);
+                            if (ns == -2) { st->unsolved = -1; return 1; }
                             if (ns >= 0) {
-                                place(ns, __builtin_ctz(cands[ns]));
-                                if (unsolved <= 0) return 1;
+                                place_tracked(st, ns, __builtin_ctz(st->cands[ns]));
+                                if (st->unsolved <= 0) return 1;
                             }
                         }
                     }
@@ -646,42 +1009,44 @@ static int hidden_triples(void) {
         }
     }
     
-    for (int b = 0; b < 9; b++) {
-        int valid[9], nv = 0;
-        for (int d = 0; d < 9; d++) {
-            int pc = __builtin_popcount(box_mask[d][b]);
+    for (int b = 0; b < N; b++) {
+        if (!(boxes >> b & 1)) continue;
+        unit_clean(dirty, UNIT_BOX, b);
+        int valid[N], nv = 0;
+        for (int d = 0; d < N; d++) {
+            int pc = __builtin_popcount(st->box_mask[d][b]);
             if (pc >= 2 && pc <= 3)
                 valid[nv++] = d;
         }
         if (nv < 3) continue;
         for (int i = 0; i < nv - 2; i++) {
-            u16 m1 = box_mask[valid[i]][b];
+            mask_t m1 = st->box_mask[valid[i]][b];
             for (int j = i + 1; j < nv - 1; j++) {
-                u16 m2 = box_mask[valid[j]][b];
-                u16 u12 = m1 | m2;
+                mask_t m2 = st->box_mask[valid[j]][b];
+                mask_t u12 = m1 | m2;
                 if (__builtin_popcount(u12) > 3) continue;
                 for (int k = j + 1; k < nv; k++) {
-                    u16 m3 = box_mask[valid[k]][b];
-                    u16 cells = u12 | m3;
+                    mask_t m3 = st->box_mask[valid[k]][b];
+                    mask_t cells = u12 | m3;
                     if (__builtin_popcount(cells) != 3) continue;
-                    u16 triple = (1 << valid[i]) | (1 << valid[j]) | (1 << valid[k]);
+                    mask_t triple = (1 << valid[i]) | (1 << valid[j]) | (1 << valid[k]);
                     int found = 0;
-                    u16 m = cells;
+                    mask_t m = cells;
                     while (m) {
                         int bp = __builtin_ctz(m);
                         m &= m - 1;
                         int cell = box_cell[b][bp];
-                        u16 elim = cands[cell] & ~triple;
+                        mask_t elim = st->cands[cell] & ~triple;
                         if (!elim) continue;
                         found = 1;
                         while (elim) {
                             int dd = __builtin_ctz(elim);
                             elim &= elim - 1;
-                            int ns = eliminate(cell, dd);
-                            if (ns == -2) { unsolved = -1; return 1; }
+                            int ns = eliminate(st, cell, dd);
+                            if (ns == -2) { st->unsolved = -1; return 1; }
                             if (ns >= 0) {
-                                place(ns, __builtin_ctz(cands[ns]));
-                                if (unsolved <= 0) return 1;
+                                place_tracked(st, ns, __builtin_ctz(st->cands[ns]));
+                                if (st->unsolved <= 0) return 1;
                             }
                         }
                     }
@@ -694,19 +1059,672 @@ static int hidden_triples(void) {
     return 0;
 }
 
-int main(void) {
-    init_tables();
-    
-    char line[256];
-    while (fgets(line, sizeof(line), stdin)) {
-        if (strlen(line) < 81) continue;
-        
-        init_puzzle(line);
-        while (unsolved > 0 && hidden_single());
-        
-        for (int i = 0; i < 81; i++)
-            putchar(grid[i] ? '0' + grid[i] : '.');
-        putchar('\n');
+// A digit with no remaining cell in a unit where it is not yet placed.
+static int stranded(SolverState *st) {
+    mask_t rows[N] = {0}, cols[N] = {0}, boxes[N] = {0};
+    for (int i = 0; i < CELLS; i++) {
+        if (!st->grid[i]) continue;
+        mask_t bit = 1 << (st->grid[i] - 1);
+        rows[cell_row[i]] |= bit; cols[cell_col[i]] |= bit; boxes[cell_box[i]] |= bit;
     }
+    for (int d = 0; d < N; d++)
+        for (int u = 0; u < N; u++) {
+            if (!st->row_mask[d][u] && !(rows[u] >> d & 1)) return 1;
+            if (!st->col_mask[d][u] && !(cols[u] >> d & 1)) return 1;
+            if (!st->box_mask[d][u] && !(boxes[u] >> d & 1)) return 1;
+        }
     return 0;
 }
+
+static int search(SolverState *st) {
+    st->nodes++;
+    STAT_INC(nodes);
+    STAT_START(t0);
+    while (st->unsolved > 0 && hidden_singles(st));
+    STAT_STOP(propagate_ns, t0);
+    if (st->unsolved <= 0) return st->unsolved == 0;
+    if (stranded(st)) return 0;
+
+    int best = -1, min = N + 1;
+    for (int i = 0; i < CELLS && min > 2; i++) {
+        if (!st->cands[i]) continue;
+        int pc = __builtin_popcount(st->cands[i]);
+        if (pc < min) { min = pc; best = i; }
+    }
+
+    int mark = st->trail_len, left = st->unsolved;
+    for (mask_t m = st->cands[best]; m; m &= m - 1) {
+        place(st, best, __builtin_ctz(m));
+        if (search(st)) return 1;
+        undo(st, mark);
+        st->unsolved = left;
+    }
+    return 0;
+}
+
+typedef int (*Technique)(SolverState *st, mask_t (*dirty)[N]);
+
+static const struct { const char *name; Technique run; } techniques[] = {
+    { "hidden_single", hidden_single },
+    { "pointing", pointing },
+    { "box_line", box_line },
+    { "naked_pairs", naked_pairs },
+    { "hidden_pairs", hidden_pairs },
+    { "naked_triples", naked_triples },
+    { "hidden_triples", hidden_triples },
+};
+
+#define NUM_TECHNIQUES (int)(sizeof(techniques) / sizeof(techniques[0]))
+
+#ifdef STATS
+_Static_assert(NUM_TECHNIQUES == STAT_TECHNIQUES, "STAT_TECHNIQUES must match the techniques table");
+
+static Stats stats_total;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *stats_path;
+static FILE *stats_lines;
+
+static void stats_merge(void) {
+    pthread_mutex_lock(&stats_lock);
+    stats_accumulate(&stats_total, &stats, NULL, sizeof(Stats));
+    memset(&stats, 0, sizeof(Stats));
+    pthread_mutex_unlock(&stats_lock);
+}
+
+// Workers share stats_lines, so a record is written under the stream's lock.
+static void stats_print(FILE *f, const Stats *s, const char *key, const char *value, int len) {
+    flockfile(f);
+    fprintf(f, "{\"%s\": \"%.*s\", \"puzzles\": %ld, \"nodes\": %ld, \"placements\": %ld, \"eliminations\": %ld, "
+            "\"sweeps\": %ld, \"propagate_ns\": %ld", key, len, value, s->puzzles, s->nodes, s->placements,
+            s->eliminations, s->sweeps, s->propagate_ns);
+    for (int t = 0; t < NUM_TECHNIQUES; t++)
+        fprintf(f, ", \"%s\": [%ld, %ld]", techniques[t].name, s->technique_calls[t], s->technique_elims[t]);
+    fprintf(f, "}\n");
+    funlockfile(f);
+}
+
+static void stats_puzzle(const Stats *before, const char *line) {
+    if (!stats_lines) return;
+    Stats d = {0};
+    stats_accumulate(&d, &stats, before, sizeof(Stats));
+    stats_print(stats_lines, &d, "puzzle", line, CELLS);
+}
+
+static void stats_finish(void) {
+    stats_merge();
+    if (stats_lines) fclose(stats_lines);
+    FILE *f = stats_path ? fopen(stats_path, "w") : NULL;
+    if (stats_path && !f) { perror(stats_path); return; }
+    if (f) { stats_print(f, &stats_total, "program", "solver", 6); fclose(f); }
+}
+#endif
+
+// Runs one technique, counting its calls and the candidates it removes.
+static inline int run_technique(SolverState *st, int t, mask_t (*dirty)[N]) {
+#ifdef STATS
+    long elims = stats.eliminations;
+    int found = techniques[t].run(st, dirty);
+    stats.technique_calls[t]++;
+    stats.technique_elims[t] += stats.eliminations - elims;
+    return found;
+#else
+    return techniques[t].run(st, dirty);
+#endif
+}
+
+// Changes not yet seen by technique k are pending[0] | ... | pending[k]:
+// place_tracked() and eliminate() mark pending[0], and each technique passes its
+// share down to the next before it runs, so a step only touches the
+// techniques it runs.
+static inline void take_pending(mask_t pending[][3][N], int k, mask_t (*dirty)[N]) {
+    for (int t = 0; t < 3; t++)
+        for (int d = 0; d < N; d++) {
+            dirty[t][d] |= pending[k][t][d];
+            pending[k + 1][t][d] |= pending[k][t][d];
+            pending[k][t][d] = 0;
+        }
+}
+
+// Applies the cheapest technique that makes progress, restarting from the top
+// after each step, until the puzzle is solved or nothing applies. Candidates
+// only shrink here, so a unit where a technique found nothing stays that way
+// until one of its masks changes: each technique keeps its own dirty units
+// and skips the rest, finding the same step as a full scan would.
+static const char *grade(SolverState *st, int steps[NUM_TECHNIQUES]) {
+    int hardest = -1;
+    mask_t dirty[NUM_TECHNIQUES][3][N], pending[NUM_TECHNIQUES + 1][3][N];
+    memset(pending, 0, sizeof(pending));
+    for (int k = 0; k < NUM_TECHNIQUES; k++)
+        for (int t = 0; t < 3; t++)
+            for (int d = 0; d < N; d++) dirty[k][t][d] = ALL_DIGITS;
+    st->changed = pending[0];
+    memset(steps, 0, NUM_TECHNIQUES * sizeof(int));
+    while (st->unsolved > 0) {
+        int t = 0;
+        while (t < NUM_TECHNIQUES) {
+            take_pending(pending, t, dirty[t]);
+            if (run_technique(st, t, dirty[t])) break;
+            t++;
+        }
+        if (t == NUM_TECHNIQUES) break;
+        steps[t]++;
+        if (t > hardest) hardest = t;
+    }
+    st->changed = NULL;
+    if (st->unsolved < 0) return "invalid";
+    if (st->unsolved > 0) return "backtrack";
+    return hardest < 0 ? "naked_single" : techniques[hardest].name;
+}
+
+enum { MODE_SINGLES, MODE_SEARCH, MODE_GRADE, MODE_CONVERT };
+
+#define OUT_MAX (CELLS + 175)
+
+static int solve_line(SolverState *st, const char *line, char *out, int mode) {
+    const char *level = NULL;
+    int steps[NUM_TECHNIQUES];
+
+    if (mode == MODE_CONVERT) {
+        for (int i = 0; i < CELLS; i++) out[i] = symbol(symbol_value(line[i]));
+        out[CELLS] = '\n';
+        return CELLS + 1;
+    }
+
+    STAT_SNAPSHOT(before);
+    STAT_INC(puzzles);
+    init_puzzle(st, line);
+    if (mode == MODE_SEARCH) {
+        trail_t trail[TRAIL_MAX];
+        st->trail = trail;
+        search(st);
+        st->trail = NULL;
+    } else if (mode == MODE_GRADE) {
+        level = grade(st, steps);
+    } else {
+        STAT_START(t0);
+        while (st->unsolved > 0 && hidden_singles(st));
+        STAT_STOP(propagate_ns, t0);
+    }
+
+    for (int i = 0; i < CELLS; i++)
+        out[i] = symbol(st->grid[i]);
+    int n = CELLS;
+    if (level) {
+        n += snprintf(out + n, OUT_MAX - n, " %s", level);
+        for (int t = 0; t < NUM_TECHNIQUES; t++)
+            n += snprintf(out + n, OUT_MAX - n, " %s=%d", techniques[t].name, steps[t]);
+    }
+    out[n++] = '\n';
+    STAT_PUZZLE(before, line);
+    return n;
+}
+
+#define CHUNK_BYTES (1 << 22)
+
+typedef struct {
+    const char *in;
+    size_t len;
+    int binary;
+    char *buf;
+    char *out;
+    size_t out_len, out_cap;
+    int done;
+} Chunk;
+
+typedef struct {
+    int fd;
+    const char *map;
+    size_t size, pos;
+    char *carry;
+    size_t carry_len;
+    int eof, binary;
+} Input;
+
+typedef struct {
+    Chunk *slots;
+    int nslots, mode, binary_out;
+    long published, taken;
+    int closed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Pipeline;
+
+// Returns the next text line of at least CELLS bytes, or the next binary
+// record unpacked into line, advancing *p; NULL at the end of the view.
+static const char *chunk_next(const Chunk *ch, const char **p, char *line) {
+    const char *end = ch->in + ch->len;
+    while (*p < end) {
+        const char *src = *p;
+        if (ch->binary) {
+            puzzle_unpack((const uint8_t *)src, line);
+            *p = src + PUZZLE_RECORD;
+            return line;
+        }
+        const char *nl = memchr(src, '\n', end - src);
+        const char *eol = nl ? nl : end;
+        *p = eol + 1;
+        if (eol - src >= CELLS) return src;
+    }
+    return NULL;
+}
+
+static void chunk_reserve(Chunk *ch) {
+    size_t need = (ch->len / (ch->binary ? PUZZLE_RECORD : CELLS) + 1) * OUT_MAX;
+    if (ch->out_cap < need) {
+        free(ch->out);
+        ch->out = malloc(need);
+        ch->out_cap = need;
+    }
+    ch->out_len = 0;
+}
+
+#ifdef LANES
+// Singles mode for LANES puzzles at once: cands[i][l] holds cell i of the
+// puzzle in lane l, so one vector is one cell across all lanes. Each pass
+// walks every unit, removes the digits of solved cells from the rest, then
+// reduces a cell holding a digit found nowhere else in the unit to that digit.
+// A lane that goes a whole pass without change has reached the fixed point
+// the scalar loop reaches, and is written out and refilled from the chunk. A
+// lane that contradicts itself (an empty cell, a digit solved twice or
+// missing from a unit, two hidden singles in one cell) is solved again by
+// solve_line, since the scalar output stops wherever it found the problem.
+typedef struct {
+    u16 cands[CELLS][LANES] __attribute__((aligned(32)));
+    const char *src[LANES];
+    char line[LANES][CELLS];
+    long slot[LANES];
+} Lanes;
+
+// One pass over every unit; returns per-lane bits (two per lane, as from
+// movemask) of the lanes that changed and of those that went wrong.
+__attribute__((target("avx2")))
+static void lanes_pass(Lanes *ln, u32 *changed, u32 *bad) {
+    const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi16(1);
+    const __m256i all = _mm256_set1_epi16(ALL_DIGITS);
+    __m256i diff = zero, err = zero;
+    for (int u = 0; u < 3*N; u++) {
+        const cell_t *cell = unit_cell[u];
+        __m256i c[N], single[N], solved = zero, twice = zero;
+        for (int k = 0; k < N; k++) {
+            c[k] = _mm256_load_si256((const __m256i *)ln->cands[cell[k]]);
+            single[k] = _mm256_cmpeq_epi16(_mm256_and_si256(c[k], _mm256_sub_epi16(c[k], one)), zero);
+            __m256i s = _mm256_and_si256(c[k], single[k]);
+            twice = _mm256_or_si256(twice, _mm256_and_si256(solved, s));
+            solved = _mm256_or_si256(solved, s);
+        }
+        __m256i v[N], once = zero, many = zero;
+        for (int k = 0; k < N; k++) {
+            v[k] = _mm256_blendv_epi8(_mm256_andnot_si256(solved, c[k]), c[k], single[k]);
+            many = _mm256_or_si256(many, _mm256_and_si256(once, v[k]));
+            once = _mm256_or_si256(once, v[k]);
+        }
+        __m256i only = _mm256_andnot_si256(many, once);
+        err = _mm256_or_si256(err, _mm256_or_si256(twice, _mm256_xor_si256(once, all)));
+        for (int k = 0; k < N; k++) {
+            __m256i h = _mm256_and_si256(v[k], only);
+            __m256i none = _mm256_cmpeq_epi16(h, zero);
+            __m256i multi = _mm256_andnot_si256(_mm256_cmpeq_epi16(_mm256_and_si256(h, _mm256_sub_epi16(h, one)), zero), all);
+            v[k] = _mm256_blendv_epi8(h, v[k], none);
+            err = _mm256_or_si256(err, _mm256_or_si256(multi, _mm256_cmpeq_epi16(v[k], zero)));
+            diff = _mm256_or_si256(diff, _mm256_xor_si256(v[k], c[k]));
+            _mm256_store_si256((__m256i *)ln->cands[cell[k]], v[k]);
+        }
+    }
+    *changed = ~_mm256_movemask_epi8(_mm256_cmpeq_epi16(diff, zero)) & 0x55555555;
+    *bad = ~_mm256_movemask_epi8(_mm256_cmpeq_epi16(err, zero)) & 0x55555555;
+}
+
+static void lanes_load(Lanes *ln, int l, const char *src) {
+    for (int i = 0; i < CELLS; i++) {
+        int v = symbol_value(src[i]);
+        ln->cands[i][l] = v ? 1 << (v - 1) : ALL_DIGITS;
+    }
+}
+
+// Writes lane l's filled cells, or '.' where more than one candidate is left.
+static void lanes_store(const Lanes *ln, int l, char *out) {
+    for (int i = 0; i < CELLS; i++) {
+        mask_t m = ln->cands[i][l];
+        out[i] = symbol(m & (m - 1) ? 0 : __builtin_ctz(m) + 1);
+    }
+    out[CELLS] = '\n';
+}
+
+static void solve_chunk_lanes(SolverState *st, Chunk *ch, int binary_out) {
+    static _Thread_local Lanes ln;
+    size_t rec = binary_out ? PUZZLE_RECORD : CELLS + 1;
+    char text[OUT_MAX];
+    const char *p = ch->in;
+    long slots = 0;
+    u32 active = 0;
+    for (;;) {
+        for (int l = 0; l < LANES; l++) {
+            if (active >> l & 1) continue;
+            const char *src = chunk_next(ch, &p, ln.line[l]);
+            if (!src) break;
+            ln.src[l] = src;
+            ln.slot[l] = slots++;
+            lanes_load(&ln, l, src);
+            active |= 1u << l;
+        }
+        if (!active) break;
+
+        u32 changed, bad;
+        lanes_pass(&ln, &changed, &bad);
+        for (u32 a = active; a; a &= a - 1) {
+            int l = __builtin_ctz(a);
+            if (changed >> 2*l & 1 && !(bad >> 2*l & 1)) continue;
+            char *out = binary_out ? text : ch->out + ln.slot[l] * rec;
+            if (bad >> 2*l & 1) solve_line(st, ln.src[l], out, MODE_SINGLES);
+            else lanes_store(&ln, l, out);
+            if (binary_out) puzzle_pack(text, (uint8_t *)ch->out + ln.slot[l] * rec);
+            active &= ~(1u << l);
+        }
+    }
+    ch->out_len = slots * rec;
+}
+#endif
+
+// Solves every text line of at least CELLS bytes, or every binary record, in
+// the input view.
+static void solve_chunk(SolverState *st, Chunk *ch, int mode, int binary_out) {
+    chunk_reserve(ch);
+#ifdef LANES
+    if (mode == MODE_SINGLES && lanes_on) {
+        solve_chunk_lanes(st, ch, binary_out);
+        return;
+    }
+#endif
+    char line[CELLS], text[OUT_MAX];
+    const char *p = ch->in, *src;
+    while ((src = chunk_next(ch, &p, line))) {
+        if (binary_out) {
+            solve_line(st, src, text, mode);
+            puzzle_pack(text, (uint8_t *)ch->out + ch->out_len);
+            ch->out_len += PUZZLE_RECORD;
+        } else {
+            ch->out_len += solve_line(st, src, ch->out + ch->out_len, mode);
+        }
+    }
+}
+
+static void *chunk_worker(void *arg) {
+    Pipeline *pl = arg;
+    SolverState st;
+    for (;;) {
+        pthread_mutex_lock(&pl->lock);
+        while (pl->taken == pl->published && !pl->closed) pthread_cond_wait(&pl->cond, &pl->lock);
+        if (pl->taken == pl->published) {
+            pthread_mutex_unlock(&pl->lock);
+            STAT_MERGE();
+            return NULL;
+        }
+        Chunk *ch = &pl->slots[pl->taken++ % pl->nslots];
+        pthread_mutex_unlock(&pl->lock);
+
+        solve_chunk(&st, ch, pl->mode, pl->binary_out);
+
+        pthread_mutex_lock(&pl->lock);
+        ch->done = 1;
+        pthread_cond_broadcast(&pl->cond);
+        pthread_mutex_unlock(&pl->lock);
+    }
+}
+
+// Fills ch with whole lines or records: a view into the mapping for files, or
+// one read from stdin whose trailing partial line or record is carried into
+// the next chunk.
+static int next_chunk(Input *in, Chunk *ch) {
+    ch->binary = in->binary;
+    if (in->map) {
+        if (in->pos >= in->size) return 0;
+        size_t end = in->pos + CHUNK_BYTES;
+        if (in->binary) end = in->pos + (CHUNK_BYTES / PUZZLE_RECORD) * PUZZLE_RECORD;
+        if (end >= in->size) end = in->size;
+        else if (!in->binary) {
+            const char *nl = memchr(in->map + end, '\n', in->size - end);
+            end = nl ? (size_t)(nl - in->map) + 1 : in->size;
+        }
+        if (in->binary) end -= (end - in->pos) % PUZZLE_RECORD;
+        if (end == in->pos) return 0;
+        ch->in = in->map + in->pos;
+        ch->len = end - in->pos;
+        in->pos = end;
+        return 1;
+    }
+
+    if (in->eof && !in->carry_len) return 0;
+    if (!ch->buf) ch->buf = malloc(CHUNK_BYTES);
+    memcpy(ch->buf, in->carry, in->carry_len);
+    size_t len = in->carry_len;
+    while (!in->eof && len < CHUNK_BYTES &&
+           (in->binary ? len < PUZZLE_RECORD : !memchr(ch->buf + in->carry_len, '\n', len - in->carry_len))) {
+        ssize_t n = read(in->fd, ch->buf + len, CHUNK_BYTES - len);
+        if (n <= 0) in->eof = 1;
+        else len += n;
+    }
+    size_t keep = len;
+    if (in->binary) keep -= len % PUZZLE_RECORD;
+    else if (!in->eof) {
+        char *nl = memrchr(ch->buf, '\n', len);
+        if (nl) keep = nl - ch->buf + 1;
+    }
+    in->carry_len = in->binary && in->eof ? 0 : len - keep;
+    memcpy(in->carry, ch->buf + keep, in->carry_len);
+    ch->in = ch->buf;
+    ch->len = keep;
+    return keep > 0 || in->carry_len > 0;
+}
+
+static void run_pipeline(Input *in, int threads, int mode, int binary_out) {
+    Pipeline pl = { .nslots = 2 * threads, .mode = mode, .binary_out = binary_out };
+    pl.slots = calloc(pl.nslots, sizeof(Chunk));
+    pthread_mutex_init(&pl.lock, NULL);
+    pthread_cond_init(&pl.cond, NULL);
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&tids[t], NULL, chunk_worker, &pl);
+
+    long written = 0;
+    int more = 1;
+    for (;;) {
+        while (more && pl.published - written < pl.nslots) {
+            Chunk *ch = &pl.slots[pl.published % pl.nslots];
+            ch->done = 0;
+            if (!(more = next_chunk(in, ch))) break;
+            pthread_mutex_lock(&pl.lock);
+            pl.published++;
+            pthread_cond_broadcast(&pl.cond);
+            pthread_mutex_unlock(&pl.lock);
+        }
+        if (written == pl.published) break;
+
+        Chunk *ch = &pl.slots[written % pl.nslots];
+        pthread_mutex_lock(&pl.lock);
+        while (!ch->done) pthread_cond_wait(&pl.cond, &pl.lock);
+        pthread_mutex_unlock(&pl.lock);
+        fwrite(ch->out, 1, ch->out_len, stdout);
+        written++;
+    }
+    fflush(stdout);
+
+    pthread_mutex_lock(&pl.lock);
+    pl.closed = 1;
+    pthread_cond_broadcast(&pl.cond);
+    pthread_mutex_unlock(&pl.lock);
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+
+    for (int i = 0; i < pl.nslots; i++) { free(pl.slots[i].buf); free(pl.slots[i].out); }
+    free(pl.slots);
+    free(tids);
+    pthread_cond_destroy(&pl.cond);
+    pthread_mutex_destroy(&pl.lock);
+}
+
+// Sets up chunked read()s of in->fd, as for stdin, pipes and other files
+// that cannot be mapped.
+static int open_stream(Input *in) {
+    in->carry = malloc(CHUNK_BYTES);
+    while (!in->eof && in->carry_len < PUZZLE_HEADER) {
+        ssize_t n = read(in->fd, in->carry + in->carry_len, PUZZLE_HEADER - in->carry_len);
+        if (n <= 0) in->eof = 1;
+        else in->carry_len += n;
+    }
+    if (N == 9 && puzzle_is_binary(in->carry, in->carry_len)) { in->binary = 1; in->carry_len = 0; }
+    return 1;
+}
+
+static int open_input(Input *in, const char *path) {
+    memset(in, 0, sizeof(*in));
+    if (!path) return open_stream(in);
+    struct stat sb;
+    in->fd = open(path, O_RDONLY);
+    if (in->fd < 0) { perror(path); return 0; }
+    if (fstat(in->fd, &sb) < 0) { perror(path); close(in->fd); return 0; }
+    if (!S_ISREG(sb.st_mode)) return open_stream(in);
+    in->size = sb.st_size;
+    if (!in->size) return 1;
+    in->map = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+    if (in->map == MAP_FAILED) { perror(path); close(in->fd); return 0; }
+    madvise((void *)in->map, in->size, MADV_SEQUENTIAL);
+    if (N == 9 && puzzle_is_binary(in->map, in->size)) { in->binary = 1; in->pos = PUZZLE_HEADER; }
+    return 1;
+}
+
+static void close_input(Input *in) {
+    if (in->map) munmap((void *)in->map, in->size);
+    if (in->fd > 0) close(in->fd);
+    free(in->carry);
+}
+
+#define BENCH_BATCH 256
+
+static void run_bench(const char **files, int nfiles, int mode, const char *json_path) {
+    FILE *json = json_path ? fopen(json_path, "w") : NULL;
+    if (json_path && !json) perror(json_path);
+    int first = 1;
+    bench_begin(json, "solver");
+
+    SolverState st;
+    char line[OUT_MAX], out[OUT_MAX];
+    // Singles mode with lanes on also feeds the lines through solve_chunk
+    // BENCH_BATCH at a time, charging each puzzle an equal share of its
+    // batch, so the "_lanes" series is the path a real run takes and the
+    // plain series stays scalar-only for comparison.
+    int lanes = mode == MODE_SINGLES && lanes_on;
+    char *batch = lanes ? malloc(BENCH_BATCH * OUT_MAX) : NULL;
+    Chunk ch = {0};
+    for (int f = 0; f < nfiles; f++) {
+        FILE *fp = fopen(files[f], "r");
+        if (!fp) { perror(files[f]); continue; }
+        BenchSeries series = {0}, lane_series = {0};
+        size_t blen = 0;
+        int bn = 0;
+        for (;;) {
+            int more = fgets(line, sizeof(line), fp) != NULL;
+            size_t len = more ? strlen(line) : 0;
+            if (lanes && bn && (!more || bn == BENCH_BATCH)) {
+                ch.in = batch;
+                ch.len = blen;
+                double t = bench_now();
+                solve_chunk(&st, &ch, MODE_SINGLES, 0);
+                t = bench_now() - t;
+                for (int i = 0; i < bn; i++) bench_add(&lane_series, t / bn, 0);
+                blen = bn = 0;
+            }
+            if (!more) break;
+            if (len < CELLS) continue;
+            double t = bench_now();
+            solve_line(&st, line, out, mode);
+            bench_add(&series, bench_now() - t, st.nodes);
+            if (lanes) {
+                memcpy(batch + blen, line, len);
+                blen += len;
+                if (line[len - 1] != '\n') batch[blen++] = '\n';
+                bn++;
+            }
+        }
+        fclose(fp);
+
+        const char *name = strrchr(files[f], '/');
+        name = name ? name + 1 : files[f];
+        char label[64];
+        snprintf(label, sizeof(label), "%.*s", (int)strcspn(name, "."), name);
+        bench_report(json, &first, label, &series);
+        snprintf(label, sizeof(label), "%.*s_lanes", (int)strcspn(name, "."), name);
+        bench_report(json, &first, label, &lane_series);
+    }
+    free(batch);
+    free(ch.out);
+
+    bench_end(json);
+    if (json) fclose(json);
+}
+
+int main(int argc, char **argv) {
+    init_tables();
+    init_simd();
+    puzzle_init();
+
+    int threads = 1, mode = MODE_SINGLES, nfiles = 0, bench = 0, binary_out = 0, no_lanes = 0;
+    const char *json = NULL, *stats_file = NULL, *lines_file = NULL;
+    const char **files = malloc(argc * sizeof(char *));
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i+1 < argc) threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--search")) mode = MODE_SEARCH;
+        else if (!strcmp(argv[i], "--grade")) mode = MODE_GRADE;
+        else if (!strcmp(argv[i], "--convert")) mode = MODE_CONVERT;
+        else if (!strcmp(argv[i], "--binary")) binary_out = 1;
+        else if (!strcmp(argv[i], "--no-lanes")) no_lanes = 1;
+        else if (!strcmp(argv[i], "--bench")) bench = 1;
+        else if (!strcmp(argv[i], "--json") && i+1 < argc) json = argv[++i];
+        else if (!strcmp(argv[i], "--stats") && i+1 < argc) stats_file = argv[++i];
+        else if (!strcmp(argv[i], "--stats-lines") && i+1 < argc) lines_file = argv[++i];
+        else if (argv[i][0] != '-') files[nfiles++] = argv[i];
+        else {
+            fprintf(stderr, "usage: %s [--threads T] [--search | --grade | --convert] [--binary] [--no-lanes] [--bench [--json FILE]] [--stats FILE] [--stats-lines FILE] [file...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (no_lanes) lanes_on = 0;
+    if (binary_out && N != 9) {
+        fprintf(stderr, "%s: --binary only supports 9x9 puzzles\n", argv[0]);
+        return 1;
+    }
+    if (binary_out && mode == MODE_GRADE) {
+        fprintf(stderr, "%s: --grade output is text only\n", argv[0]);
+        return 1;
+    }
+#ifdef STATS
+    stats_path = stats_file;
+    if (lines_file && !(stats_lines = fopen(lines_file, "w"))) { perror(lines_file); return 1; }
+    atexit(stats_finish);
+#else
+    if (stats_file || lines_file) {
+        fprintf(stderr, "%s: --stats needs a build with -DSTATS (make stats)\n", argv[0]);
+        return 1;
+    }
+#endif
+
+    if (bench) {
+        run_bench(files, nfiles, mode, json);
+        free(files);
+        return 0;
+    }
+
+    if (binary_out) {
+        uint8_t hdr[PUZZLE_HEADER];
+        puzzle_header(hdr);
+        fwrite(hdr, 1, sizeof(hdr), stdout);
+    }
+
+    int status = 0;
+    for (int f = 0; f < (nfiles ? nfiles : 1); f++) {
+        Input in;
+        if (!open_input(&in, nfiles ? files[f] : NULL)) { status = 1; continue; }
+        run_pipeline(&in, threads, mode, binary_out);
+        close_input(&in);
+    }
+    free(files);
+    return status;
+}
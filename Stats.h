@@ -0,0 +1,38 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Instrumentation counters and phase timers, compiled in with -DSTATS.
+// Each program defines a thread-local `stats` struct made only of longs
+// (timers in nanoseconds); threads add theirs into a shared total when they
+// finish, and STAT_PUZZLE writes what one puzzle cost as a JSON line through
+// the program's stats_puzzle. Without STATS the macros expand to nothing and
+// no clock is read.
+#ifdef STATS
+#include <stddef.h>
+#include "Bench.h"
+
+#define STAT_INC(field) (stats.field++)
+#define STAT_ADD(field, n) (stats.field += (n))
+#define STAT_START(t) double t = bench_now()
+#define STAT_STOP(field, t) (stats.field += (long)((bench_now() - (t)) * 1e9))
+#define STAT_SNAPSHOT(s) Stats s = stats
+#define STAT_PUZZLE(s, text) stats_puzzle(&(s), (text))
+#define STAT_MERGE() stats_merge()
+
+// dst += a - b, field by field; pass b = NULL to add a alone.
+static inline void stats_accumulate(void *dst, const void *a, const void *b, size_t size) {
+    long *d = dst;
+    const long *x = a, *y = b;
+    for (size_t i = 0; i < size / sizeof(long); i++) d[i] += x[i] - (y ? y[i] : 0);
+}
+#else
+#define STAT_INC(field) ((void)0)
+#define STAT_ADD(field, n) ((void)0)
+#define STAT_START(t) ((void)0)
+#define STAT_STOP(field, t) ((void)0)
+#define STAT_SNAPSHOT(s) ((void)0)
+#define STAT_PUZZLE(s, text) ((void)0)
+#define STAT_MERGE() ((void)0)
+#endif
+
+#endif
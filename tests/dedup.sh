@@ -0,0 +1,16 @@
+#!/bin/sh
+# Batch runs with --dedup must finish and emit the requested number of
+# distinct puzzles; a full dedup stripe used to hang them.
+set -e
+SUDOKU=${SUDOKU:-./sudoku}
+for seed in 1 4 7 11 23; do
+    for count in 500 1000; do
+        out=$(timeout 60 "$SUDOKU" --count $count --dedup --seed $seed --threads 2)
+        lines=$(printf '%s\n' "$out" | sort -u | wc -l)
+        if [ "$lines" -ne "$count" ]; then
+            echo "dedup: seed $seed count $count gave $lines distinct puzzles" >&2
+            exit 1
+        fi
+    done
+done
+echo "dedup: ok"